@@ -0,0 +1,30 @@
+QT += core serialport
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = fp-alloctest
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+# Qt 5.15 adds an overload of the signal QSocketNotifier::activated, the deprecated one is left out
+# so the signal can still be connected without naming the overload
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x050F00
+
+INCLUDEPATH += .. ../emulator
+
+SOURCES += main.cpp \
+    ../fingerprint.cpp \
+    ../packetframer.cpp \
+    ../slotbitmap.cpp \
+    ../emulator/sensoremulator.cpp
+
+HEADERS += \
+    ../fingerprint.h \
+    ../packetframer.h \
+    ../commandframe.h \
+    ../ringqueue.h \
+    ../slotbitmap.h \
+    ../emulator/sensoremulator.h
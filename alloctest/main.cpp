@@ -0,0 +1,160 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QSettings>
+#include <QThread>
+#include <QDir>
+#include <QDebug>
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "fingerprint.h"
+#include "sensoremulator.h"
+#include "defs.h"
+
+
+/*
+ * counts the heap allocations of the genImage()/image2Tz()/search() round trip of the scan loop
+ *
+ * The sensor is emulated by fp-emulator in a second thread, only allocations of the main thread
+ * (the thread of Fingerprint) are counted while a round trip is measured.
+ */
+
+static thread_local bool counting = false;
+static unsigned long allocations = 0;
+
+
+static void* allocate(std::size_t size)
+{
+	if(counting)
+	{
+		allocations++;
+	}
+	void* p = std::malloc(size ? size : 1);
+	if(!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	try { return allocate(size); } catch(...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	try { return allocate(size); } catch(...) { return nullptr; }
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+
+static bool scan(Fingerprint& fp, uint16_t capacity, uint16_t& id)
+{
+	uint16_t score;
+	return fp.genImage()==Fingerprint::OK && fp.image2Tz(Fingerprint::SLOT_1)==Fingerprint::OK
+			&& fp.search(Fingerprint::SLOT_1, 0, capacity, id, score)==Fingerprint::OK;
+}
+
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("allocations per scan round trip of fp-server against the sensor emulator");
+	parser.addHelpOption();
+	parser.addOptions({
+		{"rounds", "Number of measured round trips (default 100).", "n", "100"},
+		{"max", "Maximum allocations per round trip, exit code 1 above (default 0).", "n", "0"},
+	});
+	parser.process(a);
+
+	int rounds = qMax(parser.value("rounds").toInt(), 1);
+	double max = parser.value("max").toDouble();
+	const uint16_t capacity = 127;
+
+	// fp-server reads its configuration from the working directory
+	QTemporaryDir dir;
+	if(!dir.isValid() || !QDir::setCurrent(dir.path()))
+	{
+		qCritical() << "cannot create a temporary directory";
+		return 2;
+	}
+	QString link = dir.filePath("ttyFP");
+	{
+		QSettings conf(CONFIG_FILE, QSettings::IniFormat);
+		conf.setValue("SERIAL_PORT", link);
+		conf.setValue("SERIAL_TIMEOUT", 2);
+	}
+
+	// the emulator runs its own event loop, the sensor thread of fp-server does not have one
+	QThread sensorThread;
+	SensorEmulator* emulator = new SensorEmulator();
+	emulator->setTiming({1, 1, 1, 1, 1});
+	emulator->moveToThread(&sensorThread);
+	QObject::connect(&sensorThread, &QThread::finished, emulator, &QObject::deleteLater);
+	sensorThread.start();
+
+	bool opened = false;
+	QMetaObject::invokeMethod(emulator, [&]()
+	{
+		opened = emulator->open(link, capacity, 57600);
+		emulator->placeFinger(1);
+	}, Qt::BlockingQueuedConnection);
+
+	int result = 2;
+	{
+		Fingerprint fp;
+		uint16_t id = 0;
+
+		if(!opened || !fp.start())
+		{
+			qCritical() << "no connection to the emulated sensor";
+		}
+		else if(fp.emptyDatabase()!=Fingerprint::OK
+				|| fp.genImage()!=Fingerprint::OK || fp.image2Tz(Fingerprint::SLOT_1)!=Fingerprint::OK
+				|| fp.genImage()!=Fingerprint::OK || fp.image2Tz(Fingerprint::SLOT_2)!=Fingerprint::OK
+				|| fp.createModel()!=Fingerprint::OK || fp.storeModel(Fingerprint::SLOT_1, 7)!=Fingerprint::OK)
+		{
+			qCritical() << "enrollment failed";
+		}
+		else
+		{
+			// warm up, the buffers reach their working size
+			for(int i = 0; i < 3; i++)
+			{
+				scan(fp, capacity, id);
+			}
+
+			int failed = 0;
+			for(int i = 0; i < rounds; i++)
+			{
+				counting = true;
+				bool found = scan(fp, capacity, id);
+				counting = false;
+
+				if(!found || id!=7)
+				{
+					failed++;
+				}
+			}
+
+			double perRound = double(allocations) / rounds;
+			std::printf("%d round trips, %lu allocations, %.2f per round trip, %d failed\n",
+						rounds, allocations, perRound, failed);
+			result = (failed==0 && perRound<=max) ? 0 : 1;
+		}
+	}
+
+	sensorThread.quit();
+	sensorThread.wait();
+	return result;
+}
@@ -0,0 +1,115 @@
+#include "changelog.h"
+#include "dbworker.h"
+
+#include <QDebug>
+
+
+#define LOG_RETENTION_DAYS 7			// age of log entries that are pruned
+#define PRUNE_INTERVAL (3600*1000)		// (milliseconds)
+#define LOG_OVERLAP 60					// (seconds) entries below the watermark that are read again
+
+
+ChangeLog::ChangeLog(DbWorker* db)
+{
+	this->db = db;
+	available = false;
+	watermark = 0;
+	pending = 0;
+}
+
+
+/*
+ * check for the log table and start at its current end, <done> is called by DbWorker::deliver()
+ * submit before the queries of the full comparison of sensor library and database,
+ * changes during the comparison are returned again by poll()
+ */
+void ChangeLog::start(Started done)
+{
+	db->query("SELECT MAX(seq) FROM fingerprint_log", QVariantList(), [this, done](bool ok, const DbWorker::Rows& rows)
+	{
+		available = ok && !rows.isEmpty();
+		if(!available)
+		{
+			qWarning() << "change log not available, scanning the database for updates";
+			done(false);
+			return;
+		}
+		
+		watermark = rows[0][0].toULongLong();
+		pending = watermark;
+		pendingSeqs.clear();
+		applied.clear();
+		pruneTimer.start();
+		
+		qDebug() << "change log available, watermark:" << watermark;
+		done(true);
+	});
+}
+
+
+/*
+ * read the IDs changed after the watermark, <done> is called by DbWorker::deliver()
+ * sequence numbers are taken at insert time, not at commit time, a transaction can commit a lower number
+ * after a higher one was read, so the entries of the last LOG_OVERLAP seconds are read again and the
+ * sequence numbers applied before are skipped
+ */
+void ChangeLog::poll(Polled done)
+{
+	db->query("SELECT seq, id FROM fingerprint_log WHERE seq > ? OR changed > NOW() - INTERVAL ? SECOND ORDER BY seq ASC",
+			  {watermark, LOG_OVERLAP}, [this, done](bool ok, const DbWorker::Rows& rows)
+	{
+		QSet<int> changedIds;
+		if(!ok)
+		{
+			qCritical() << "change log: failed to read changes";
+			done(false, changedIds);
+			return;
+		}
+		
+		pending = watermark;
+		pendingSeqs.clear();
+		for(const QVariantList& row : rows)
+		{
+			quint64 seq = row[0].toULongLong();
+			pendingSeqs.insert(seq);
+			if(seq <= watermark && applied.contains(seq))
+			{
+				continue;
+			}
+			if(seq <= watermark)
+			{
+				qDebug() << "change log: late entry" << seq << "below the watermark";
+			}
+			pending = qMax(pending, seq);
+			changedIds.insert(row[1].toInt());
+		}
+		done(true, changedIds);
+	});
+}
+
+
+/*
+ * the changes returned by the last poll() were applied
+ */
+void ChangeLog::acknowledge()
+{
+	watermark = pending;
+	
+	// the entries outside of the overlap are not read again
+	applied = pendingSeqs;
+}
+
+
+/*
+ * remove old entries from the log, runs once per PRUNE_INTERVAL
+ */
+void ChangeLog::prune()
+{
+	if(!available || pruneTimer.elapsed() < PRUNE_INTERVAL)
+	{
+		return;
+	}
+	pruneTimer.restart();
+	
+	db->write(QString("DELETE FROM fingerprint_log WHERE changed < NOW() - INTERVAL %1 DAY").arg(LOG_RETENTION_DAYS), QVariantList(), nullptr);
+}
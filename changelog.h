@@ -0,0 +1,45 @@
+#ifndef CHANGELOG_H
+#define CHANGELOG_H
+
+#include <QSet>
+#include <QElapsedTimer>
+
+#include <functional>
+
+class DbWorker;
+
+/*
+ * reads the change log of the fingerprint table (see fingerprint_log.sql)
+ * 
+ * Every insert, update and delete in the fingerprint table appends the affected ID to the log.
+ * poll() returns the IDs changed after the watermark and the late entries of the recent past,
+ * the watermark is advanced by acknowledge() once the changes were applied to the sensor. Without the log table the database has to be scanned.
+ * The queries are executed by the DbWorker.
+ */
+class ChangeLog
+{
+public:
+	typedef std::function<void(bool ok, const QSet<int>& changedIds)> Polled;
+	typedef std::function<void(bool available)> Started;
+	
+	explicit ChangeLog(DbWorker* db);
+	
+	void start(Started done);
+	bool isAvailable() const { return available; }
+	
+	void poll(Polled done);
+	void acknowledge();
+	
+	void prune();
+	
+private:
+	DbWorker* db;
+	bool available;
+	quint64 watermark;			// all changes up to this sequence number are applied
+	quint64 pending;			// last sequence number returned by poll()
+	QSet<quint64> pendingSeqs;	// sequence numbers read by the last poll()
+	QSet<quint64> applied;		// sequence numbers read again in the overlap that were already applied
+	QElapsedTimer pruneTimer;
+};
+
+#endif // CHANGELOG_H
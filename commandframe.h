@@ -0,0 +1,146 @@
+#ifndef COMMANDFRAME_H
+#define COMMANDFRAME_H
+
+/*
+ * transmit side of the ZFM-20 serial protocol
+ *
+ * Commands are described by constant descriptors (command code, size of the arguments, size of the ACK,
+ * minimum timeout). A frame is encoded into a fixed size buffer that is part of the object, the checksum
+ * is computed while the bytes are written, so sending a command does not allocate memory.
+ */
+
+#include <stdint.h>
+
+#include <QByteArray>
+
+
+struct CommandDescriptor
+{
+	uint8_t code;		// command code
+	uint8_t argSize;	// size of the arguments in bytes, shorter arguments are padded with zeros
+	uint8_t ackSize;	// expected size of the ACK content
+	uint16_t timeout;	// (milliseconds) minimum timeout of the command, 0: serial timeout
+};
+
+
+class CommandFrame
+{
+public:
+
+	static const int HEADER_SIZE=9;		// start code, address, packet type, length
+	static const int MAX_ARGS=1+32;		// largest arguments: notepad page and content
+	static const int MAX_SIZE=HEADER_SIZE+1+MAX_ARGS+2;
+
+	CommandFrame() : cmd(nullptr), length(0), pos(0), sum(0) {}
+	
+	/*
+	 * encode a command packet for <command>, 8 bit (uint8_t) and 16 bit (uint16_t, big endian) arguments
+	 * and byte arrays are appended in the order given
+	 */
+	template<typename... Args>
+	CommandFrame(uint32_t addr, const CommandDescriptor& command, Args... args) : cmd(&command)
+	{
+		length=HEADER_SIZE + 1 + cmd->argSize + 2;
+		encodeHeader(buffer, addr, 0x01, 1 + cmd->argSize);
+		sum=checksum(buffer);
+
+		pos=HEADER_SIZE;
+		append(cmd->code);
+		put(args...);
+
+		// padding
+		while(pos<HEADER_SIZE + 1 + cmd->argSize)
+		{
+			buffer[pos++]=0;
+		}
+
+		buffer[pos++]=char(sum>>8);
+		buffer[pos++]=char(sum);
+	}
+
+	const char* data() const { return buffer; }
+	int size() const { return length; }
+	const CommandDescriptor& descriptor() const { return *cmd; }
+
+	/*
+	 * encode a packet with <size> bytes of content into <packet> (HEADER_SIZE+size+2 bytes)
+	 * return value: size of the packet
+	 */
+	static int encode(char* packet, uint32_t addr, uint8_t type, const char* data, int size)
+	{
+		encodeHeader(packet, addr, type, uint16_t(size));
+		uint16_t sum=checksum(packet);
+
+		for(int i=0; i<size; i++)
+		{
+			packet[HEADER_SIZE+i]=data[i];
+			sum+=uint8_t(data[i]);
+		}
+
+		packet[HEADER_SIZE+size]=char(sum>>8);
+		packet[HEADER_SIZE+size+1]=char(sum);
+		return HEADER_SIZE+size+2;
+	}
+
+private:
+
+	static void encodeHeader(char* packet, uint32_t addr, uint8_t type, uint16_t contentSize)
+	{
+		uint16_t len=contentSize+2;		// length of the content including checksum
+		packet[0]=char(0xEF);			// start code
+		packet[1]=char(0x01);
+		packet[2]=char(addr>>24);
+		packet[3]=char(addr>>16);
+		packet[4]=char(addr>>8);
+		packet[5]=char(addr);
+		packet[6]=char(type);
+		packet[7]=char(len>>8);
+		packet[8]=char(len);
+	}
+
+	// checksum of the header: packet type and length
+	static uint16_t checksum(const char* packet)
+	{
+		return uint16_t(uint8_t(packet[6]) + uint8_t(packet[7]) + uint8_t(packet[8]));
+	}
+
+	void put() {}
+
+	template<typename T, typename... Rest>
+	void put(T first, Rest... rest)
+	{
+		append(first);
+		put(rest...);
+	}
+
+	void append(uint8_t value)
+	{
+		if(pos<HEADER_SIZE + 1 + cmd->argSize)
+		{
+			buffer[pos++]=char(value);
+			sum+=value;
+		}
+	}
+
+	void append(uint16_t value)
+	{
+		append(uint8_t(value>>8));
+		append(uint8_t(value & 0xFF));
+	}
+
+	void append(const QByteArray& bytes)
+	{
+		for(int i=0; i<bytes.size(); i++)
+		{
+			append(uint8_t(bytes[i]));
+		}
+	}
+
+	const CommandDescriptor* cmd;
+	char buffer[MAX_SIZE];
+	int length;		// size of the packet
+	int pos;		// write position while encoding
+	uint16_t sum;	// checksum of the bytes written so far
+};
+
+#endif // COMMANDFRAME_H
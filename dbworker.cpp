@@ -0,0 +1,377 @@
+#include "dbworker.h"
+#include "defs.h"
+
+#include <QDebug>
+#include <QSettings>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QtSql>
+
+
+#define MAX_STATEMENTS 32		// prepared statements kept
+#define RECONNECT_TIME 5000		// (milliseconds) minimum time between two connection attempts
+
+
+DbWorker::DbWorker(QObject *parent) : QThread(parent)
+{
+	connection = "dbworker";
+	lost = false;
+	
+	QSettings conf(CONFIG_FILE, QSettings::IniFormat, this);
+	DATABASE_NAME = conf.value("DATABASE_NAME", "minutiae").toString();
+	DATABASE_USER = conf.value("DATABASE_USER", "fp-server").toString();
+	DATABASE_PASSWD = conf.value("DATABASE_PASSWD", "DY50").toString();
+}
+
+
+/*
+ * queue a read, <done> is called by deliver() with the result rows
+ */
+void DbWorker::query(const QString& sql, const QVariantList& values, Result done)
+{
+	submit({sql, values, false, done});
+}
+
+
+/*
+ * queue a write, writes that are queued together are executed in one transaction
+ * <done> is called by deliver()
+ */
+void DbWorker::write(const QString& sql, const QVariantList& values, Result done)
+{
+	submit({sql, values, true, done});
+}
+
+
+/*
+ * read the rows for a list of <ids>, <sql> contains the ID list as "(?)", e.g. "... WHERE id IN (?)"
+ * the IDs are bound in batches of ID_BATCH placeholders, the last batch is padded with its last ID
+ * <done> is called once with the rows of all batches, ok is false if a batch failed
+ */
+void DbWorker::queryIds(const QString& sql, const QList<int>& ids, Result done)
+{
+	submitIds(sql, ids, false, done);
+}
+
+
+/*
+ * write for a list of <ids>, see queryIds()
+ * the batches are separate statements, a repeated write of the same IDs has to be harmless
+ */
+void DbWorker::writeIds(const QString& sql, const QList<int>& ids, Result done)
+{
+	submitIds(sql, ids, true, done);
+}
+
+
+/*
+ * call the completion callbacks of the executed requests
+ * return value: number of delivered results
+ */
+int DbWorker::deliver()
+{
+	int delivered = 0;
+	Reply reply;
+	while(replies.pop(reply))
+	{
+		inFlight.fetchAndAddOrdered(-1);
+		delivered++;
+		if(reply.done)
+		{
+			reply.done(reply.ok, reply.rows);
+		}
+	}
+	return delivered;
+}
+
+
+void DbWorker::submit(const Request& request)
+{
+	// the reply queue holds the results of all requests in flight
+	if(inFlight.loadAcquire() >= QUEUE_SIZE || !requests.push(request))
+	{
+		qCritical() << "DbWorker: request queue full:" << request.sql;
+		if(request.done)
+		{
+			request.done(false, Rows());
+		}
+		return;
+	}
+	inFlight.fetchAndAddOrdered(1);
+	
+	mutex.lock();
+	wakeup.wakeOne();
+	mutex.unlock();
+}
+
+
+void DbWorker::submitIds(const QString& sql, const QList<int>& ids, bool write, Result done)
+{
+	if(ids.isEmpty())
+	{
+		if(done)
+		{
+			done(true, Rows());
+		}
+		return;
+	}
+	
+	QStringList placeholders;
+	for(int i = 0; i < ID_BATCH; i++)
+	{
+		placeholders.append("?");
+	}
+	QString batchSql = QString(sql).replace("(?)", "(" + placeholders.join(",") + ")");
+	
+	// results of the batches, collected until the last one is delivered
+	struct Collected
+	{
+		int pending;
+		bool ok;
+		Rows rows;
+	};
+	QSharedPointer<Collected> collected(new Collected{(ids.size() + ID_BATCH - 1) / ID_BATCH, true, Rows()});
+	
+	for(int first = 0; first < ids.size(); first += ID_BATCH)
+	{
+		QVariantList values;
+		for(int i = 0; i < ID_BATCH; i++)
+		{
+			values.append(ids[qMin(first + i, ids.size() - 1)]);
+		}
+		
+		submit({batchSql, values, write, [collected, done](bool ok, const Rows& rows)
+		{
+			collected->ok = collected->ok && ok;
+			collected->rows += rows;
+			if(--collected->pending == 0 && done)
+			{
+				done(collected->ok, collected->rows);
+			}
+		}});
+	}
+}
+
+
+void DbWorker::run()
+{
+	reconnect();
+	
+	while(true)
+	{
+		mutex.lock();
+		while(requests.isEmpty())
+		{
+			wakeup.wait(&mutex);
+		}
+		mutex.unlock();
+		
+		// consecutive writes are collected and executed together
+		QList<Request> writes;
+		Request request;
+		while(requests.pop(request))
+		{
+			if(request.write)
+			{
+				writes.append(request);
+				continue;
+			}
+			
+			executeWrites(writes);
+			
+			Rows rows;
+			bool ok = execute(request, rows);
+			replies.push({ok, rows, request.done});
+			
+			if(lost)
+			{
+				reconnect();
+			}
+		}
+		executeWrites(writes);
+		
+		if(notify)
+		{
+			notify();
+		}
+	}
+}
+
+
+/*
+ * open the connection of the worker, the statement cache is cleared
+ */
+bool DbWorker::open()
+{
+	statements.clear();
+	
+	QSqlDatabase db = QSqlDatabase::contains(connection) ? QSqlDatabase::database(connection, false) : QSqlDatabase::addDatabase("QMYSQL", connection);
+	db.close();
+	db.setHostName("127.0.0.1");
+	db.setDatabaseName(DATABASE_NAME);
+	db.setUserName(DATABASE_USER);
+	db.setPassword(DATABASE_PASSWD);
+	if(!db.open())
+	{
+		qCritical() << "DbWorker: could not connect to database:" << db.lastError().text();
+		connected.storeRelease(0);
+		return false;
+	}
+	
+	qDebug() << "DbWorker: connected to database";
+	lost = false;
+	connections.fetchAndAddOrdered(1);
+	connected.storeRelease(1);
+	return true;
+}
+
+
+/*
+ * connect again, at most once every RECONNECT_TIME milliseconds
+ * return value: false if the connection is not open, the requests fail until the next attempt
+ */
+bool DbWorker::reconnect()
+{
+	if(lastConnect.isValid() && lastConnect.elapsed() < RECONNECT_TIME)
+	{
+		return false;
+	}
+	lastConnect.start();
+	return open();
+}
+
+
+/*
+ * the connection to the server is lost, MariaDB reports a restart as a statement error
+ */
+bool DbWorker::isConnectionLost(const QSqlError& error)
+{
+	// CR_SERVER_GONE_ERROR, CR_SERVER_LOST
+	return error.type() == QSqlError::ConnectionError || error.nativeErrorCode() == "2006" || error.nativeErrorCode() == "2013";
+}
+
+
+/*
+ * execute a single statement with the cached prepared statement
+ * additional return parameter:
+ *	* result rows (reads only)
+ */
+bool DbWorker::execute(const Request& request, Rows& rows)
+{
+	QSqlDatabase db = QSqlDatabase::database(connection, false);
+	if(lost || !db.isOpen())
+	{
+		// fails straight away until the next connection attempt
+		if(!reconnect())
+		{
+			return false;
+		}
+		db = QSqlDatabase::database(connection, false);
+	}
+	
+	if(!statements.contains(request.sql))
+	{
+		if(statements.size() >= MAX_STATEMENTS)
+		{
+			statements.clear();
+		}
+		
+		QSqlQuery query(db);
+		query.setForwardOnly(true);
+		if(!query.prepare(request.sql))
+		{
+			qCritical() << "DbWorker: failed to prepare" << request.sql << ":" << query.lastError().text();
+			return false;
+		}
+		statements.insert(request.sql, query);
+	}
+	
+	QSqlQuery& query = statements[request.sql];
+	for(int i = 0; i < request.values.size(); i++)
+	{
+		query.bindValue(i, request.values[i]);
+	}
+	
+	if(!query.exec())
+	{
+		qCritical() << "DbWorker: failed to execute" << request.sql << ":" << query.lastError().text();
+		if(isConnectionLost(query.lastError()))
+		{
+			// reconnected after the current batch, the submitting thread synchronizes again
+			lost = true;
+			connected.storeRelease(0);
+		}
+		return false;
+	}
+	
+	if(!request.write)
+	{
+		int columns = query.record().count();
+		while(query.next())
+		{
+			QVariantList row;
+			for(int i = 0; i < columns; i++)
+			{
+				row.append(query.value(i));
+			}
+			rows.append(row);
+		}
+	}
+	query.finish();
+	
+	return true;
+}
+
+
+/*
+ * execute <writes> in one transaction and queue their results
+ * a failed write rolls the transaction back, all writes of the batch fail
+ */
+void DbWorker::executeWrites(QList<Request>& writes)
+{
+	if(writes.isEmpty())
+	{
+		return;
+	}
+	
+	QSqlDatabase db = QSqlDatabase::database(connection, false);
+	if((lost || !db.isOpen()) && reconnect())
+	{
+		db = QSqlDatabase::database(connection, false);
+	}
+	bool transaction = (writes.size() > 1) && db.isOpen() && db.transaction();
+	
+	QVector<bool> results(writes.size(), false);
+	for(int i = 0; i < writes.size(); i++)
+	{
+		Rows rows;
+		results[i] = execute(writes[i], rows);
+		if(!results[i] && transaction)
+		{
+			// no reconnect within the transaction, the rest would be committed on its own
+			qCritical() << "DbWorker: rollback of" << writes.size() << "writes";
+			db.rollback();
+			transaction = false;
+			results.fill(false);
+			break;
+		}
+	}
+	
+	if(transaction && !db.commit())
+	{
+		qCritical() << "DbWorker: failed to commit" << writes.size() << "writes:" << db.lastError().text();
+		db.rollback();
+		results.fill(false);
+	}
+	
+	for(int i = 0; i < writes.size(); i++)
+	{
+		replies.push({results[i], Rows(), writes[i].done});
+	}
+	writes.clear();
+	
+	if(lost)
+	{
+		reconnect();
+	}
+}
@@ -0,0 +1,101 @@
+#ifndef DBWORKER_H
+#define DBWORKER_H
+
+#include <QThread>
+#include <QHash>
+#include <QVector>
+#include <QVariant>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QSqlQuery>
+#include <QSqlError>
+
+#include <functional>
+
+#include "spscqueue.h"
+
+/*
+ * database access in a separate thread, so that a slow database does not delay the sensor
+ * 
+ * The worker owns its own database connection and keeps the prepared statements. Requests are
+ * submitted by one thread (FpThread) and executed in order, consecutive writes are executed in a
+ * single transaction. The results are returned to the submitting thread by deliver().
+ * Statements for lists of IDs (queryIds(), writeIds()) bind the IDs in batches of a fixed number
+ * of placeholders, so their statement text does not change and the prepared statement is reused.
+ * After a lost connection the worker reconnects at most every RECONNECT_TIME, requests fail
+ * immediately in between.
+ */
+class DbWorker : public QThread
+{
+	Q_OBJECT
+public:
+	typedef QVector<QVariantList> Rows;
+	typedef std::function<void(bool ok, const Rows& rows)> Result;
+	
+	explicit DbWorker(QObject *parent = nullptr);
+	
+	// called by the submitting thread
+	void query(const QString& sql, const QVariantList& values, Result done);
+	void write(const QString& sql, const QVariantList& values, Result done);
+	void queryIds(const QString& sql, const QList<int>& ids, Result done);
+	void writeIds(const QString& sql, const QList<int>& ids, Result done);
+	int deliver();
+	bool isBusy() const { return inFlight.loadAcquire() > 0; }
+	bool isConnected() const { return connected.loadAcquire() != 0; }
+	int connectionCount() const { return connections.loadAcquire(); }	// incremented with every (re)connect
+	
+	// called by the worker thread when results are ready for deliver(), set before start()
+	typedef std::function<void()> Notify;
+	void setNotify(Notify notify) { this->notify = notify; }
+	
+private:
+	static const int QUEUE_SIZE = 64;
+	static const int ID_BATCH = 32;		// placeholders of the ID list in queryIds() and writeIds()
+	
+	struct Request
+	{
+		QString sql;			// statement with positional placeholders (?)
+		QVariantList values;	// values of the placeholders
+		bool write;
+		Result done;
+	};
+	
+	struct Reply
+	{
+		bool ok;
+		Rows rows;
+		Result done;
+	};
+	
+	void run();
+	void submit(const Request& request);
+	void submitIds(const QString& sql, const QList<int>& ids, bool write, Result done);
+	bool open();
+	bool reconnect();
+	static bool isConnectionLost(const QSqlError& error);
+	bool execute(const Request& request, Rows& rows);
+	void executeWrites(QList<Request>& writes);
+	
+	SpscQueue<Request, QUEUE_SIZE> requests;	// submitting thread -> worker
+	SpscQueue<Reply, QUEUE_SIZE> replies;		// worker -> submitting thread
+	QAtomicInt inFlight;						// submitted requests whose result was not delivered yet
+	QAtomicInt connected;						// the connection of the worker is open
+	QAtomicInt connections;						// number of successful connects
+	QMutex mutex;
+	QWaitCondition wakeup;						// requests were submitted
+	Notify notify;
+	
+	// worker thread only
+	QString connection;
+	QHash<QString, QSqlQuery> statements;		// prepared statements by SQL text
+	bool lost;									// the connection was lost, reconnect after the current batch
+	QElapsedTimer lastConnect;					// time of the last connection attempt
+	
+	// configuration
+	QString DATABASE_NAME;		// name of database
+	QString DATABASE_USER;		// user name for database
+	QString DATABASE_PASSWD;	// password for database user
+};
+
+#endif // DBWORKER_H
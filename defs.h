@@ -2,5 +2,7 @@
 #define DEFS_H
 
 #define CONFIG_FILE	"fp-server.conf"
+#define STATE_FILE	"fp-server.state"		// state that is kept between restarts
+#define SNAPSHOT_FILE	"fp-server.snapshot"	// local copy of the templates in the database
 
 #endif // DEFS_H
@@ -0,0 +1,105 @@
+#include "dooractuator.h"
+#include "defs.h"
+
+#include <QDebug>
+#include <QSettings>
+
+
+DoorActuator::DoorActuator(Gpio* gpio, QObject *parent) : QObject(parent)
+{
+	this->gpio = gpio;
+	
+	QSettings conf(CONFIG_FILE, QSettings::IniFormat, this);
+	SINGLE_OPEN_TIME = conf.value("SINGLE_OPEN_TIME", 5).toUInt();
+	BUZZ_OPEN_PWM = conf.value("BUZZ_OPEN_PWM", 256).toUInt();
+	BUZZ_PULSE_TIME = conf.value("BUZZ_PULSE_TIME", 100).toUInt();
+	
+	pulseTimer.setSingleShot(true);
+	pulseTimer.setInterval(int(BUZZ_PULSE_TIME));
+	connect(&pulseTimer, SIGNAL(timeout()), this, SLOT(pulseFinished()));
+	
+	relockTimer.setSingleShot(true);
+	relockTimer.setInterval(int(SINGLE_OPEN_TIME) * 1000);
+	connect(&relockTimer, SIGNAL(timeout()), this, SLOT(lock()));
+	
+	doorState = PULSE;		// force output update
+	keepOpenActive = false;
+	lock();
+}
+
+
+const char* DoorActuator::stateName(State state)
+{
+	switch(state)
+	{
+		case LOCKED: return "LOCKED";
+		case PULSE: return "PULSE";
+		case HOLD: return "HOLD";
+	}
+	return "UNKNOWN";
+}
+
+
+void DoorActuator::unlock(bool keepOpen)
+{
+	qDebug() << "UNLOCK, keepOpen:" << keepOpen;
+	
+	if(keepOpen)
+	{
+		keepOpenActive = true;
+		relockTimer.stop();
+	}
+	else if(!keepOpenActive)
+	{
+		// (re)start relock deadline, measured from the latest unlock
+		relockTimer.start();
+	}
+	
+	if(doorState == LOCKED)
+	{
+		gpio->setBuzzer(Gpio::PWM_RANGE);			// door buzzer full power
+		gpio->write(Gpio::LED_GREEN, true);			// green LED on
+		gpio->write(Gpio::LED_RED, false);			// red LED off
+		pulseTimer.start();
+		setState(PULSE);
+	}
+}
+
+
+void DoorActuator::lock()
+{
+	pulseTimer.stop();
+	relockTimer.stop();
+	keepOpenActive = false;
+	
+	if(doorState == LOCKED)
+	{
+		return;
+	}
+	
+	qDebug() << "LOCK";
+	gpio->setBuzzer(0);							// buzzer off
+	gpio->write(Gpio::LED_GREEN, false);		// green LED off
+	gpio->write(Gpio::LED_RED, true);			// red LED on
+	setState(LOCKED);
+}
+
+
+void DoorActuator::pulseFinished()
+{
+	if(doorState == PULSE)
+	{
+		gpio->setBuzzer(BUZZ_OPEN_PWM);			// reduce buzzer pwm to minimize power dissipation
+		setState(HOLD);
+	}
+}
+
+
+void DoorActuator::setState(State state)
+{
+	if(doorState != state)
+	{
+		doorState = state;
+		emit stateChanged(state);
+	}
+}
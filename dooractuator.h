@@ -0,0 +1,55 @@
+#ifndef DOORACTUATOR_H
+#define DOORACTUATOR_H
+
+#include <QObject>
+#include <QTimer>
+
+#include "gpio.h"
+
+/*
+ * timer driven state machine for the door buzzer and LEDs
+ * 
+ * LOCKED --unlock()--> PULSE --BUZZ_PULSE_TIME--> HOLD --SINGLE_OPEN_TIME--> LOCKED
+ * 
+ * Nothing blocks the event loop. An unlock while the door is already open only moves
+ * the relock deadline, so overlapping unlocks result in a single relock.
+ */
+class DoorActuator : public QObject
+{
+	Q_OBJECT
+public:
+	explicit DoorActuator(Gpio* gpio, QObject *parent = nullptr);
+	
+	enum State {LOCKED = 0, PULSE = 1, HOLD = 2};
+	
+	State state() const {return doorState;}
+	bool keepOpen() const {return keepOpenActive;}
+	
+	static const char* stateName(State state);
+	
+signals:
+	void stateChanged(DoorActuator::State state);
+	
+public slots:
+	void unlock(bool keepOpen);
+	void lock();
+	
+private slots:
+	void pulseFinished();
+	
+private:
+	void setState(State state);
+	
+	Gpio* gpio;
+	State doorState;
+	bool keepOpenActive;		// unlocked until lock() is called
+	QTimer pulseTimer;
+	QTimer relockTimer;
+	
+	// configuration
+	uint32_t SINGLE_OPEN_TIME;		// (seconds) unlock time for single access
+	uint32_t BUZZ_OPEN_PWM;			// PWM duty cycle (1024=max) used for keeping door buzzer open
+	uint32_t BUZZ_PULSE_TIME;		// (milliseconds) initial pulse time to open door buzzer
+};
+
+#endif // DOORACTUATOR_H
@@ -0,0 +1,24 @@
+QT += core
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = fp-emulator
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+# Qt 5.15 adds an overload of the signal QSocketNotifier::activated, the deprecated one is left out
+# so the signal can still be connected without naming the overload
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x050F00
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    sensoremulator.cpp \
+    ../packetframer.cpp
+
+HEADERS += \
+    sensoremulator.h \
+    ../packetframer.h
@@ -0,0 +1,140 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QSocketNotifier>
+#include <QTextStream>
+#include <QTimer>
+#include <QFile>
+#include <QDebug>
+
+#include <unistd.h>
+
+#include "sensoremulator.h"
+
+
+/*
+ * finger commands (from script or stdin):
+ *	finger <n>	place finger number <n> on the sensor
+ *	lift		remove finger
+ *	stats		print statistics
+ *	quit		print statistics and exit
+ * script lines are prefixed by the time in milliseconds after start: <ms> <command>
+ */
+static void execute(SensorEmulator& emulator, const QString& line)
+{
+	QStringList args = line.simplified().split(' ');
+	if(args.isEmpty() || args[0].isEmpty() || args[0].startsWith("#"))
+	{
+		return;
+	}
+	
+	if(args[0] == "finger" && args.size() == 2)
+	{
+		emulator.placeFinger(args[1].toInt());
+	}
+	else if(args[0] == "lift")
+	{
+		emulator.liftFinger();
+	}
+	else if(args[0] == "stats")
+	{
+		emulator.printStats();
+	}
+	else if(args[0] == "quit")
+	{
+		emulator.printStats();
+		QCoreApplication::quit();
+	}
+	else
+	{
+		qWarning() << "unknown command:" << line;
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	
+	QCommandLineParser parser;
+	parser.setApplicationDescription("ZFM-20 fingerprint sensor emulator on a pseudo-terminal");
+	parser.addHelpOption();
+	parser.addOptions({
+		{"link", "Create symlink <path> to the pty slave device.", "path"},
+		{"capacity", "Library size (default 127).", "n", "127"},
+		{"baud", "Initial baud rate of the sensor (default 57600).", "baud", "57600"},
+		{"script", "Finger presence script.", "file"},
+		{"search-time", "Search time per library entry in microseconds (default 1000).", "us", "1000"},
+		{"checksum-errors", "Probability of a corrupted checksum per packet.", "p", "0"},
+		{"drop-bytes", "Probability of a dropped byte per byte sent.", "p", "0"},
+		{"stalls", "Probability of a stalled reply per packet.", "p", "0"},
+		{"stall-time", "Duration of a stall in milliseconds (default 3000).", "ms", "3000"},
+		{"touch", "Named pipe that receives a byte when a finger is placed (touch output).", "path"},
+	});
+	parser.process(a);
+	
+	SensorEmulator emulator;
+	
+	SensorEmulator::Timing timing = {150, 20, 200, 30, parser.value("search-time").toInt()};
+	emulator.setTiming(timing);
+	
+	SensorEmulator::Faults faults = {parser.value("checksum-errors").toDouble(), parser.value("drop-bytes").toDouble(),
+									 parser.value("stalls").toDouble(), parser.value("stall-time").toInt()};
+	emulator.setFaults(faults);
+	emulator.setTouchOutput(parser.value("touch"));
+	
+	if(!emulator.open(parser.value("link"), uint16_t(parser.value("capacity").toInt()), parser.value("baud").toInt()))
+	{
+		return 1;
+	}
+	
+	// timed finger events
+	if(parser.isSet("script"))
+	{
+		QFile script(parser.value("script"));
+		if(!script.open(QIODevice::ReadOnly | QIODevice::Text))
+		{
+			qCritical() << "cannot open script" << script.fileName();
+			return 1;
+		}
+		
+		QTextStream in(&script);
+		while(!in.atEnd())
+		{
+			QString line = in.readLine().simplified();
+			if(line.isEmpty() || line.startsWith("#"))
+			{
+				continue;
+			}
+			int time = line.section(' ', 0, 0).toInt();
+			QString command = line.section(' ', 1);
+			QTimer::singleShot(time, &emulator, [&emulator, command]()
+			{
+				execute(emulator, command);
+			});
+		}
+	}
+	
+	// interactive commands
+	QByteArray input;
+	QSocketNotifier stdinNotifier(STDIN_FILENO, QSocketNotifier::Read);
+	QObject::connect(&stdinNotifier, &QSocketNotifier::activated, [&emulator, &stdinNotifier, &input]()
+	{
+		char buffer[256];
+		ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+		if(n <= 0)
+		{
+			stdinNotifier.setEnabled(false);		// end of input
+			return;
+		}
+		input.append(buffer, int(n));
+		
+		int end;
+		while((end = input.indexOf('\n')) >= 0)
+		{
+			execute(emulator, QString::fromLocal8Bit(input.left(end)));
+			input.remove(0, end+1);
+		}
+	});
+	
+	return a.exec();
+}
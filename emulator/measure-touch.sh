@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# compare continuous scanning with touch-triggered scanning (TOUCH_WAKEUP) against fp-emulator:
+# CPU load of fp-server while no finger is on the sensor, and the time from placing a finger
+# to the search reply (statistics of the emulator)
+#
+# usage: measure-touch.sh [fp-server] [fp-emulator] [idle seconds] [touches]
+# the database does not have to be available, fp-server starts with the recorded library content
+#
+
+FP_SERVER=$(readlink -f "${1:-../fp-server}")
+FP_EMULATOR=$(readlink -f "${2:-./fp-emulator}")
+IDLE_TIME=${3:-60}
+TOUCHES=${4:-20}
+CONF=$(readlink -f "$(dirname "$0")/../fp-server.conf")
+
+if [ ! -x "$FP_SERVER" ] || [ ! -x "$FP_EMULATOR" ]; then
+	echo "usage: $0 [fp-server] [fp-emulator] [idle seconds] [touches]" >&2
+	exit 1
+fi
+
+TICKS=$(getconf CLK_TCK)
+
+# user + system time of process <pid> in clock ticks
+cpu_ticks()
+{
+	awk '{print $14 + $15}' "/proc/$1/stat"
+}
+
+# measure <mode>: continuous or touch
+measure()
+{
+	MODE=$1
+	DIR=$(mktemp -d)
+
+	if [ "$MODE" = touch ]; then WAKEUP=true; else WAKEUP=false; fi
+	sed -e "s|^SERIAL_PORT *=.*|SERIAL_PORT = \"$DIR/ttyFP\"|" \
+		-e "s|^GPIO_BACKEND *=.*|GPIO_BACKEND = fake|" \
+		-e "s|^GPIO_FAKE_DIR *=.*|GPIO_FAKE_DIR = \"$DIR/gpio\"|" \
+		-e "s|^TOUCH_WAKEUP *=.*|TOUCH_WAKEUP = $WAKEUP|" \
+		-e "s|^SCAN_INTERVAL_MIN *=.*|SCAN_INTERVAL_MIN = 0|" \
+		-e "s|^SCAN_INTERVAL_MAX *=.*|SCAN_INTERVAL_MAX = 0|" \
+		"$CONF" > "$DIR/fp-server.conf"
+
+	# finger script: idle phase, then a touch every 3 s (finger 1 s on the sensor)
+	START=$(( (IDLE_TIME + 10) * 1000 ))
+	i=0
+	while [ $i -lt "$TOUCHES" ]; do
+		echo "$(( START + i*3000 )) finger $(( i % 5 + 1 ))"
+		echo "$(( START + i*3000 + 1000 )) lift"
+		i=$(( i + 1 ))
+	done > "$DIR/fingers.txt"
+	echo "$(( START + TOUCHES*3000 + 1000 )) quit" >> "$DIR/fingers.txt"
+
+	"$FP_EMULATOR" --link "$DIR/ttyFP" --touch "$DIR/gpio/touch" --script "$DIR/fingers.txt" \
+		< /dev/null > "$DIR/emulator.log" 2>&1 &
+	EMULATOR=$!
+	sleep 1
+
+	(cd "$DIR" && exec "$FP_SERVER") > "$DIR/fp-server.log" 2>&1 &
+	SERVER=$!
+
+	# startup (baud rate negotiation, reconcile), then the idle phase without finger
+	sleep 10
+	T0=$(cpu_ticks $SERVER)
+	sleep "$IDLE_TIME"
+	T1=$(cpu_ticks $SERVER)
+
+	wait $EMULATOR
+	kill $SERVER
+	wait $SERVER 2>/dev/null
+
+	echo "$MODE:"
+	echo "  idle CPU: $(awk -v t="$((T1 - T0))" -v hz="$TICKS" -v s="$IDLE_TIME" 'BEGIN {printf "%.2f %%", 100*t/hz/s}')"
+	grep -h "detections:\|time to match" "$DIR/emulator.log" | sed 's/^/ /'
+	grep -h "touch to match:" "$DIR/fp-server.log" | awk '{sum += $(NF-1); n++} END {if(n) printf "  touch to match (fp-server): %d, avg %.0f ms\n", n, sum/n}'
+	echo "  logs: $DIR"
+}
+
+measure continuous
+measure touch
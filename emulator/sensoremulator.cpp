@@ -0,0 +1,726 @@
+#include "sensoremulator.h"
+
+#include <QDebug>
+#include <QTimer>
+#include <QFile>
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+
+#define STARTCODE 0xEF01
+#define THEADDRESS 0xFFFFFFFF
+#define TEMPSIZE 512
+
+// packet types and status codes, see Fingerprint
+#define COMMAND 0x01
+#define DATA 0x02
+#define ACK 0x07
+#define END 0x08
+
+#define OK 0x00
+#define PACKETRECIEVEERR 0x01
+#define NOFINGER 0x02
+#define NOMATCH 0x08
+#define NOTFOUND 0x09
+#define ENROLLMISMATCH 0x0A
+#define BADPAGEID 0x0B
+#define INVALIDTEMPLATE 0x0C
+#define DELETEFAIL 0x10
+#define INVALIDIMAGE 0x15
+#define INVALIDREG 0x1A
+#define NOTEPADERR 0x1C
+
+
+static double randomValue()
+{
+	return double(rand()) / RAND_MAX;
+}
+
+
+SensorEmulator::SensorEmulator(QObject *parent) : QObject(parent)
+{
+	masterFd = -1;
+	notifier = nullptr;
+	
+	timing = {150, 20, 200, 30, 1000};
+	faults = {0.0, 0.0, 0.0, 0};
+	
+	capacity = 127;
+	baud = 57600;
+	sizeCode = 2;
+	securityLevel = 3;
+	finger = -1;
+	imageFinger = -1;
+	receiveSlot = -1;
+	for(int i=0; i<16; i++)
+	{
+		notepad[i] = QByteArray(32, 0);
+	}
+	
+	lineFreeAt = 0;
+	fingerTime = 0;
+	fingerSearched = false;
+	
+	bytesIn = 0;
+	bytesOut = 0;
+	baudMismatches = 0;
+	faultsInjected = 0;
+	matches = 0;
+	matchTimeSum = 0;
+	matchTimeMax = 0;
+	detections = 0;
+	detectTimeSum = 0;
+	detectTimeMax = 0;
+	
+	clock.start();
+}
+
+
+SensorEmulator::~SensorEmulator()
+{
+	if(masterFd >= 0)
+	{
+		close(masterFd);
+	}
+	if(!linkPath.isEmpty())
+	{
+		unlink(linkPath.toLocal8Bit().constData());
+	}
+}
+
+
+/*
+ * create the pseudo-terminal, if <link> is not empty a symlink to the slave device is created
+ */
+bool SensorEmulator::open(const QString& link, uint16_t capacity, int baud)
+{
+	this->capacity = capacity;
+	this->baud = baud;
+	
+	masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+	if(masterFd < 0 || grantpt(masterFd) != 0 || unlockpt(masterFd) != 0)
+	{
+		qCritical() << "SensorEmulator: cannot create pseudo-terminal";
+		return false;
+	}
+	fcntl(masterFd, F_SETFL, fcntl(masterFd, F_GETFL) | O_NONBLOCK);
+	
+	QString slave = QString::fromLocal8Bit(ptsname(masterFd));
+	
+	if(!link.isEmpty())
+	{
+		unlink(link.toLocal8Bit().constData());
+		if(symlink(ptsname(masterFd), link.toLocal8Bit().constData()) != 0)
+		{
+			qCritical() << "SensorEmulator: cannot create link" << link;
+			return false;
+		}
+		linkPath = link;
+	}
+	
+	notifier = new QSocketNotifier(masterFd, QSocketNotifier::Read, this);
+	connect(notifier, &QSocketNotifier::activated, this, &SensorEmulator::readable);
+	
+	qInfo() << "SensorEmulator: sensor at" << (link.isEmpty() ? slave : link) << "(" << slave << ")," << capacity << "templates," << baud << "baud";
+	return true;
+}
+
+
+void SensorEmulator::setTiming(const Timing& timing)
+{
+	this->timing = timing;
+}
+
+
+void SensorEmulator::setFaults(const Faults& faults)
+{
+	this->faults = faults;
+}
+
+
+/*
+ * emulate the touch output of the sensor: a byte is written to the named pipe <path> when a finger is placed,
+ * fp-server reads it with GPIO_BACKEND = fake (GPIO_FAKE_DIR/touch)
+ */
+void SensorEmulator::setTouchOutput(const QString& path)
+{
+	touchPath = path;
+}
+
+
+void SensorEmulator::placeFinger(int finger)
+{
+	this->finger = finger;
+	fingerTime = clock.elapsed();
+	fingerSearched = false;
+	qInfo() << "SensorEmulator: finger" << finger << "placed";
+	
+	if(!touchPath.isEmpty())
+	{
+		// fails without a reader, the touch is lost like an edge without a listener
+		int fd = ::open(touchPath.toLocal8Bit().constData(), O_WRONLY | O_NONBLOCK);
+		if(fd < 0 || ::write(fd, "t", 1) != 1)
+		{
+			qWarning() << "SensorEmulator: could not signal touch to" << touchPath;
+		}
+		if(fd >= 0)
+		{
+			::close(fd);
+		}
+	}
+}
+
+
+void SensorEmulator::liftFinger()
+{
+	finger = -1;
+	qInfo() << "SensorEmulator: finger lifted";
+}
+
+
+void SensorEmulator::printStats()
+{
+	qInfo() << "SensorEmulator statistics:";
+	qInfo() << "\tbytes in:" << bytesIn << "out:" << bytesOut;
+	for(int command : commandCount.keys())
+	{
+		qInfo() << "\tcommand" << QString("0x%1").arg(command, 2, 16, QChar('0')) << ":" << commandCount.value(command);
+	}
+	qInfo() << "\tlibrary:" << library.size() << "templates";
+	qInfo() << "\tbaud rate mismatches:" << baudMismatches << "faults injected:" << faultsInjected;
+	if(matches > 0)
+	{
+		qInfo() << "\tmatches:" << matches << "time to match avg:" << matchTimeSum/matches << "ms max:" << matchTimeMax << "ms";
+	}
+	if(detections > 0)
+	{
+		qInfo() << "\tdetections:" << detections << "time to search reply avg:" << detectTimeSum/detections
+				<< "ms max:" << detectTimeMax << "ms";
+	}
+}
+
+
+/************************************************************/
+/*					private functions:						*/
+/************************************************************/
+
+void SensorEmulator::readable()
+{
+	while(true)
+	{
+		int space;
+		char* p = framer.writePointer(space);
+		ssize_t n = read(masterFd, p, size_t(space));
+		if(n <= 0)
+		{
+			break;
+		}
+		bytesIn += n;
+		
+		// host and sensor have to use the same baud rate, otherwise the sensor only receives garbage
+		if(hostBaudRate() != baud)
+		{
+			baudMismatches++;
+			continue;
+		}
+		framer.commit(int(n));
+		
+		uint8_t type;
+		QByteArray data;
+		PacketFramer::Result result;
+		while((result = framer.next(type, data)) != PacketFramer::NEED_MORE)
+		{
+			if(result == PacketFramer::BAD_CHECKSUM)
+			{
+				reply(PACKETRECIEVEERR);
+				continue;
+			}
+			
+			if(type == COMMAND)
+			{
+				handleCommand(data);
+			}
+			else
+			{
+				handleData(type, data);
+			}
+		}
+	}
+}
+
+
+void SensorEmulator::handleCommand(const QByteArray& data)
+{
+	if(data.isEmpty())
+	{
+		reply(PACKETRECIEVEERR);
+		return;
+	}
+	
+	uint8_t command = uint8_t(data[0]);
+	commandCount[command]++;
+	
+	auto u8 = [&](int i) { return i < data.size() ? int(uint8_t(data[i])) : 0; };
+	auto u16 = [&](int i) { return (u8(i)<<8) | u8(i+1); };
+	
+	switch(command)
+	{
+		case 0x01:		// GENIMAGE
+		{
+			if(finger < 0)
+			{
+				reply(NOFINGER, QByteArray(), timing.genImageEmpty);
+				break;
+			}
+			imageFinger = finger;
+			reply(OK, QByteArray(), timing.genImage);
+			break;
+		}
+			
+		case 0x02:		// IMAGE2TZ
+		{
+			int slot = u8(1);
+			if(slot < 1 || slot > 2 || imageFinger < 0)
+			{
+				reply(INVALIDIMAGE);
+				break;
+			}
+			charBuffer[slot-1] = feature(imageFinger);
+			reply(OK, QByteArray(), timing.image2Tz);
+			break;
+		}
+			
+		case 0x03:		// MATCH
+		{
+			int a = fingerOf(charBuffer[0]);
+			bool match = (a >= 0 && a == fingerOf(charBuffer[1]));
+			uint16_t score = match ? 100 : 0;
+			reply(match ? OK : NOMATCH, QByteArray().append(char(score>>8)).append(char(score & 0xFF)), 5);
+			break;
+		}
+			
+		case 0x04:		// SEARCH
+		{
+			int slot = u8(1);
+			int start = u16(2);
+			int count = u16(4);
+			int searchTime = int(qint64(count) * timing.searchPerTemplate / 1000);
+			
+			int f = (slot >= 1 && slot <= 2) ? fingerOf(charBuffer[slot-1]) : -1;
+			for(int id = start; id < start+count && id < capacity; id++)
+			{
+				if(f >= 0 && fingerOf(library.value(id)) == f)
+				{
+					// the search stops at the first match
+					searchTime = int(qint64(id-start+1) * timing.searchPerTemplate / 1000);
+					
+					qint64 matchTime = clock.elapsed() + searchTime - fingerTime;
+					matches++;
+					matchTimeSum += matchTime;
+					matchTimeMax = qMax(matchTimeMax, matchTime);
+					
+					searched(f, searchTime);
+					uint16_t score = 100;
+					reply(OK, QByteArray().append(char(id>>8)).append(char(id & 0xFF)).append(char(score>>8)).append(char(score & 0xFF)), searchTime);
+					return;
+				}
+			}
+			searched(f, searchTime);
+			reply(NOTFOUND, QByteArray(4, 0), searchTime);
+			break;
+		}
+			
+		case 0x05:		// REGMODEL
+		{
+			int a = fingerOf(charBuffer[0]);
+			if(a < 0 || a != fingerOf(charBuffer[1]))
+			{
+				reply(ENROLLMISMATCH, QByteArray(), 50);
+				break;
+			}
+			reply(OK, QByteArray(), 50);
+			break;
+		}
+			
+		case 0x06:		// STORE
+		{
+			int slot = u8(1);
+			int id = u16(2);
+			if(id >= capacity || slot < 1 || slot > 2)
+			{
+				reply(BADPAGEID);
+				break;
+			}
+			library.insert(id, charBuffer[slot-1]);
+			reply(OK, QByteArray(), timing.store);
+			break;
+		}
+			
+		case 0x07:		// LOADCHAR
+		{
+			int slot = u8(1);
+			int id = u16(2);
+			if(id >= capacity || slot < 1 || slot > 2)
+			{
+				reply(BADPAGEID);
+				break;
+			}
+			if(!library.contains(id))
+			{
+				reply(INVALIDTEMPLATE);
+				break;
+			}
+			charBuffer[slot-1] = library.value(id);
+			reply(OK, QByteArray(), 10);
+			break;
+		}
+			
+		case 0x08:		// UPCHAR
+		{
+			int slot = u8(1);
+			if(slot < 1 || slot > 2)
+			{
+				reply(INVALIDREG);
+				break;
+			}
+			reply(OK);
+			
+			QByteArray model = charBuffer[slot-1];
+			model.append(QByteArray(TEMPSIZE - qMin(TEMPSIZE, model.size()), 0));
+			int packetSize = 32<<sizeCode;
+			for(int pos = 0; pos < TEMPSIZE; pos += packetSize)
+			{
+				sendPacket(pos+packetSize < TEMPSIZE ? DATA : END, model.mid(pos, packetSize));
+			}
+			break;
+		}
+			
+		case 0x09:		// DOWNCHAR
+		{
+			int slot = u8(1);
+			if(slot < 1 || slot > 2)
+			{
+				reply(INVALIDREG);
+				break;
+			}
+			receiveSlot = slot;
+			receiveData.clear();
+			reply(OK);
+			break;
+		}
+			
+		case 0x0C:		// DELETE
+		{
+			int id = u16(1);
+			int count = u16(3);
+			if(id+count > capacity)
+			{
+				reply(DELETEFAIL);
+				break;
+			}
+			for(int i = id; i < id+count; i++)
+			{
+				library.remove(i);
+			}
+			reply(OK, QByteArray(), timing.store);
+			break;
+		}
+			
+		case 0x0D:		// EMPTY
+		{
+			library.clear();
+			reply(OK, QByteArray(), timing.store);
+			break;
+		}
+			
+		case 0x0E:		// SETSYSPARA
+		{
+			int param = u8(1);
+			int value = u8(2);
+			if(param == 4 && value >= 1 && value <= 12)
+			{
+				// the ACK is sent at the old baud rate
+				reply(OK);
+				baud = value*9600;
+				qInfo() << "SensorEmulator: baud rate" << baud;
+			}
+			else if(param == 5 && value >= 1 && value <= 5)
+			{
+				securityLevel = value;
+				reply(OK);
+			}
+			else if(param == 6 && value <= 3)
+			{
+				sizeCode = value;
+				reply(OK);
+				qInfo() << "SensorEmulator: data packet size" << (32<<sizeCode);
+			}
+			else
+			{
+				reply(INVALIDREG);
+			}
+			break;
+		}
+			
+		case 0x0F:		// READSYSPARA
+		{
+			QByteArray params;
+			params.append(char(0)).append(char(receiveSlot >= 0 ? 1 : 0));		// status register
+			params.append(char(0)).append(char(0x09));								// system identifier code
+			params.append(char(capacity>>8)).append(char(capacity & 0xFF));
+			params.append(char(0)).append(char(securityLevel));
+			params.append(QByteArray(4, char(0xFF)));								// device address
+			params.append(char(0)).append(char(sizeCode));
+			params.append(char(0)).append(char(baud/9600));
+			reply(OK, params);
+			break;
+		}
+			
+		case 0x17:		// HANDSHAKE
+		{
+			reply(OK);
+			break;
+		}
+			
+		case 0x18:		// WRITENOTEPAD
+		{
+			int page = u8(1);
+			if(page >= 16 || data.size() != 2+32)
+			{
+				reply(NOTEPADERR);
+				break;
+			}
+			notepad[page] = data.mid(2);
+			reply(OK, QByteArray(), timing.store);
+			break;
+		}
+			
+		case 0x19:		// READNOTEPAD
+		{
+			int page = u8(1);
+			if(page >= 16)
+			{
+				reply(NOTEPADERR);
+				break;
+			}
+			reply(OK, notepad[page]);
+			break;
+		}
+			
+		case 0x1D:		// TEMPLATECOUNT
+		{
+			int count = library.size();
+			reply(OK, QByteArray().append(char(count>>8)).append(char(count & 0xFF)));
+			break;
+		}
+			
+		case 0x1F:		// READINDEXTABLE
+		{
+			int page = u8(1);
+			QByteArray table(32, 0);
+			for(int id : library.keys())
+			{
+				int i = id - page*256;
+				if(i >= 0 && i < 256)
+				{
+					table[i/8] = char(uint8_t(table[i/8]) | (1<<(i%8)));
+				}
+			}
+			reply(OK, table);
+			break;
+		}
+			
+		default:
+		{
+			qWarning() << "SensorEmulator: unsupported command" << command;
+			reply(PACKETRECIEVEERR);
+			break;
+		}
+	}
+}
+
+
+/*
+ * DATA/END packets following DOWNCHAR
+ */
+void SensorEmulator::handleData(uint8_t type, const QByteArray& data)
+{
+	if(receiveSlot < 0 || (type != DATA && type != END))
+	{
+		qWarning() << "SensorEmulator: unexpected packet, type:" << type;
+		return;
+	}
+	
+	int packetSize = 32<<sizeCode;
+	if(type == DATA && data.size() != packetSize)
+	{
+		qWarning() << "SensorEmulator: DATA packet size" << data.size() << "does not match" << packetSize;
+		receiveSlot = -1;
+		return;
+	}
+	
+	receiveData.append(data);
+	
+	if(type == END)
+	{
+		charBuffer[receiveSlot-1] = receiveData;
+		receiveSlot = -1;
+	}
+}
+
+
+void SensorEmulator::reply(uint8_t status, const QByteArray& params, int processingTime)
+{
+	sendPacket(ACK, QByteArray().append(char(status)).append(params), processingTime);
+}
+
+
+/*
+ * schedule a packet, it is sent after the processing time and the time needed to transmit it at the current baud rate
+ */
+void SensorEmulator::sendPacket(uint8_t type, const QByteArray& data, int processingTime)
+{
+	uint16_t len = uint16_t(data.size()+2);
+	uint16_t sum = uint16_t(type + (len>>8) + (len & 0xFF));
+	
+	QByteArray packet;
+	packet.append(char(STARTCODE>>8)).append(char(STARTCODE & 0xFF));
+	packet.append(QByteArray(4, char(0xFF)));
+	packet.append(char(type)).append(char(len>>8)).append(char(len & 0xFF));
+	for(int i=0; i<data.size(); i++)
+	{
+		sum = uint16_t(sum + uint8_t(data[i]));
+	}
+	packet.append(data);
+	packet.append(char(sum>>8)).append(char(sum & 0xFF));
+	
+	// fault injection
+	if(randomValue() < faults.checksumError)
+	{
+		packet[packet.size()-1] = char(packet[packet.size()-1] ^ 0x01);
+		faultsInjected++;
+	}
+	if(faults.dropByte > 0)
+	{
+		for(int i = packet.size()-1; i >= 0; i--)
+		{
+			if(randomValue() < faults.dropByte)
+			{
+				packet.remove(i, 1);
+				faultsInjected++;
+			}
+		}
+	}
+	if(randomValue() < faults.stall)
+	{
+		processingTime += faults.stallTime;
+		faultsInjected++;
+	}
+	
+	qint64 now = clock.elapsed();
+	qint64 start = qMax(now, lineFreeAt) + processingTime;
+	lineFreeAt = start + wireTime(packet.size());
+	
+	QTimer::singleShot(int(lineFreeAt - now), this, [this, packet]()
+	{
+		writeRaw(packet);
+	});
+}
+
+
+void SensorEmulator::writeRaw(const QByteArray& bytes)
+{
+	int pos = 0;
+	while(pos < bytes.size())
+	{
+		ssize_t n = write(masterFd, bytes.constData()+pos, size_t(bytes.size()-pos));
+		if(n <= 0)
+		{
+			// host does not read, drop the rest like a real serial line
+			break;
+		}
+		pos += int(n);
+	}
+	bytesOut += pos;
+}
+
+
+/*
+ * (milliseconds) time to transmit <bytes> with 8N1 framing
+ */
+qint64 SensorEmulator::wireTime(int bytes) const
+{
+	return qint64(bytes) * 10 * 1000 / baud;
+}
+
+
+/*
+ * baud rate configured by the host on the slave side of the pty
+ */
+int SensorEmulator::hostBaudRate() const
+{
+	struct termios tio;
+	if(tcgetattr(masterFd, &tio) != 0)
+	{
+		return 0;
+	}
+	
+	switch(cfgetospeed(&tio))
+	{
+		case B9600:		return 9600;
+		case B19200:	return 19200;
+		case B38400:	return 38400;
+		case B57600:	return 57600;
+		case B115200:	return 115200;
+		default:		return 0;
+	}
+}
+
+
+/*
+ * character file of a finger: magic, finger number, pseudo random content derived from the finger number
+ */
+QByteArray SensorEmulator::feature(int finger)
+{
+	QByteArray charFile("EMUF");
+	charFile.append(char(finger>>8)).append(char(finger & 0xFF));
+	
+	uint32_t x = uint32_t(finger)*2654435761u + 1;
+	while(charFile.size() < TEMPSIZE)
+	{
+		x = x*1103515245u + 12345u;
+		charFile.append(char(x>>16));
+	}
+	return charFile;
+}
+
+
+int SensorEmulator::fingerOf(const QByteArray& charFile)
+{
+	if(charFile.size() < 6 || !charFile.startsWith("EMUF"))
+	{
+		return -1;
+	}
+	return (int(uint8_t(charFile[4]))<<8) | uint8_t(charFile[5]);
+}
+
+
+/*
+ * first search for the placed finger <f>: time from placing the finger to the search reply, also without a match
+ */
+void SensorEmulator::searched(int f, int searchTime)
+{
+	if(f < 0 || f != finger || fingerSearched)
+	{
+		return;
+	}
+	fingerSearched = true;
+	
+	qint64 detectTime = clock.elapsed() + searchTime - fingerTime;
+	detections++;
+	detectTimeSum += detectTime;
+	detectTimeMax = qMax(detectTimeMax, detectTime);
+}
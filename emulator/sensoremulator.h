@@ -0,0 +1,121 @@
+#ifndef SENSOREMULATOR_H
+#define SENSOREMULATOR_H
+
+/*
+ * emulator of the ZFM-20 fingerprint sensor (DY-50) behind a pseudo-terminal
+ * 
+ * fp-server can be pointed at the pty with SERIAL_PORT. The emulator keeps a template library,
+ * emulates wire time at the configured baud rate and the processing time of the sensor,
+ * and can inject faults (checksum errors, dropped bytes, stalls).
+ * 
+ * Fingers are identified by a number. A finger placed on the sensor produces a character file
+ * that matches every template created from the same finger.
+ */
+
+#include <QObject>
+#include <QSocketNotifier>
+#include <QElapsedTimer>
+#include <QHash>
+
+#include "packetframer.h"
+
+
+class SensorEmulator : public QObject
+{
+	Q_OBJECT
+public:
+	
+	// timing of the sensor
+	struct Timing
+	{
+		int genImage;			// (milliseconds) image capture with finger present
+		int genImageEmpty;		// (milliseconds) image capture without finger
+		int image2Tz;			// (milliseconds) feature extraction
+		int store;				// (milliseconds) flash write
+		int searchPerTemplate;	// (microseconds) search time per library entry
+	};
+	
+	// fault injection
+	struct Faults
+	{
+		double checksumError;	// probability of a corrupted checksum per packet
+		double dropByte;		// probability of a dropped byte per byte sent
+		double stall;			// probability of a stalled reply per packet
+		int stallTime;			// (milliseconds) duration of a stall
+	};
+	
+	explicit SensorEmulator(QObject *parent = nullptr);
+	~SensorEmulator();
+	
+	bool open(const QString& link, uint16_t capacity, int baud);
+	
+	void setTiming(const Timing& timing);
+	void setFaults(const Faults& faults);
+	void setTouchOutput(const QString& path);
+	
+	void placeFinger(int finger);
+	void liftFinger();
+	void printStats();
+	
+private slots:
+	void readable();
+	
+private:
+	
+	void handleCommand(const QByteArray& data);
+	void handleData(uint8_t type, const QByteArray& data);
+	void reply(uint8_t status, const QByteArray& params=QByteArray(), int processingTime=0);
+	void sendPacket(uint8_t type, const QByteArray& data, int processingTime=0);
+	void writeRaw(const QByteArray& bytes);
+	void searched(int f, int searchTime);
+	
+	qint64 wireTime(int bytes) const;
+	int hostBaudRate() const;
+	static QByteArray feature(int finger);
+	static int fingerOf(const QByteArray& charFile);
+	
+	int masterFd;
+	QString linkPath;
+	QSocketNotifier* notifier;
+	PacketFramer framer;
+	
+	Timing timing;
+	Faults faults;
+	
+	// sensor state
+	uint16_t capacity;
+	int baud;
+	int sizeCode;
+	int securityLevel;
+	int finger;					// finger on the sensor, -1 if there is none
+	QString touchPath;			// named pipe that receives a byte for every placed finger (touch output)
+	int imageFinger;			// finger in the image buffer, -1 if there is no valid image
+	QByteArray charBuffer[2];
+	QHash<int, QByteArray> library;
+	QByteArray notepad[16];
+	
+	// DOWNCHAR in progress
+	int receiveSlot;			// -1 if no data is expected
+	QByteArray receiveData;
+	
+	// timing
+	QElapsedTimer clock;
+	qint64 lineFreeAt;			// (milliseconds) time when the last scheduled reply is sent completely
+	qint64 fingerTime;			// (milliseconds) time when the finger was placed
+	bool fingerSearched;		// a search reply was sent for the placed finger
+	
+	// statistics
+	QHash<int, int> commandCount;
+	qint64 bytesIn;
+	qint64 bytesOut;
+	int baudMismatches;
+	int faultsInjected;
+	int matches;
+	qint64 matchTimeSum;
+	qint64 matchTimeMax;
+	int detections;				// placements with a search reply, matched or not
+	qint64 detectTimeSum;
+	qint64 detectTimeMax;
+};
+
+#endif // SENSOREMULATOR_H
@@ -34,9 +34,32 @@
 #include "defs.h"
 
 
-#define STARTCODE 0xEF01				// packet start code
 #define THEADDRESS 0xFFFFFFFF			// default sensor address
 #define TEMPSIZE 512					// size of template file in bytes
+#define PACKET_OVERHEAD 11				// bytes of a packet besides the content: start code, address, type, length, checksum
+#define DEFAULT_BAUD 57600				// factory default baud rate of the sensor
+#define PROBE_TIMEOUT 200				// (milliseconds) timeout while searching for the baud rate of the sensor
+#define VERIFY_COUNT 3					// number of handshakes to verify the serial link
+#define LINK_ERROR_LIMIT 3				// number of consecutive packet errors/timeouts until the baud rate is lowered
+#define DOWNLOAD_SETTLE 10				// (milliseconds) gap between the last data packet of a download and the next command
+
+// command descriptors: command code, size of the arguments, size of the ACK, (milliseconds) minimum timeout
+static constexpr CommandDescriptor CMD_GENIMAGE			= {Fingerprint::GENIMAGE,		0,	1,	0};
+static constexpr CommandDescriptor CMD_IMAGE2TZ			= {Fingerprint::IMAGE2TZ,		1,	1,	0};
+static constexpr CommandDescriptor CMD_MATCH			= {Fingerprint::MATCH,			0,	3,	0};
+static constexpr CommandDescriptor CMD_SEARCH			= {Fingerprint::SEARCH,			5,	5,	3000};
+static constexpr CommandDescriptor CMD_REGMODEL			= {Fingerprint::REGMODEL,		0,	1,	0};
+static constexpr CommandDescriptor CMD_STORE			= {Fingerprint::STORE,			3,	1,	0};
+static constexpr CommandDescriptor CMD_LOADCHAR			= {Fingerprint::LOADCHAR,		3,	1,	0};
+static constexpr CommandDescriptor CMD_UPCHAR			= {Fingerprint::UPCHAR,			1,	1,	0};
+static constexpr CommandDescriptor CMD_DOWNCHAR			= {Fingerprint::DOWNCHAR,		1,	1,	0};
+static constexpr CommandDescriptor CMD_DELETE			= {Fingerprint::DELETE,			4,	1,	3000};
+static constexpr CommandDescriptor CMD_EMPTY			= {Fingerprint::EMPTY,			0,	1,	3000};
+static constexpr CommandDescriptor CMD_SETSYSPARA		= {Fingerprint::SETSYSPARA,		2,	1,	0};
+static constexpr CommandDescriptor CMD_READSYSPARA		= {Fingerprint::READSYSPARA,	0,	17,	0};
+static constexpr CommandDescriptor CMD_WRITENOTEPAD		= {Fingerprint::WRITENOTEPAD,	1+Fingerprint::NOTEPAD_SIZE,	1,	0};
+static constexpr CommandDescriptor CMD_READNOTEPAD		= {Fingerprint::READNOTEPAD,	1,	1+Fingerprint::NOTEPAD_SIZE,	0};
+static constexpr CommandDescriptor CMD_READINDEXTABLE	= {Fingerprint::READINDEXTABLE,	1,	1+Fingerprint::INDEX_PAGE_SIZE/8,	0};
 
 
 
@@ -46,8 +69,32 @@ Fingerprint::Fingerprint()
 	
 	SERIAL_TIMEOUT = conf.value("SERIAL_TIMEOUT", 5).toInt();
 	MAX_FINGERS = conf.value("MAX_FINGERS", 1000).toInt();
+	MAX_BAUD = conf.value("MAX_BAUD", 115200).toInt();
+	MAX_PACKET_SIZE = conf.value("MAX_PACKET_SIZE", 256).toInt();
+	
+	// start with the baud rate that was used last time
+	QSettings stateFile(STATE_FILE, QSettings::IniFormat);
+	baud = stateFile.value("serial/baud", DEFAULT_BAUD).toInt();
+	requestTimeout = SERIAL_TIMEOUT*1000;
+	linkErrors = 0;
+	settleDelay = 0;
+	packetSize = 128;
 	
 	serial = new QSerialPort(conf.value("SERIAL_PORT", "/dev/ttyS0").toString());
+	
+	state = IDLE;
+	
+	// the receive buffers keep their capacity, a round trip does not allocate
+	rxPacket.reserve(PacketFramer::MAX_PACKET_LEN);
+	rxData.reserve(TEMPSIZE);
+	
+	// the packet engine is driven by the serial port signals
+	// (emitted by the event loop or from within waitForReadyRead()/waitForBytesWritten())
+	connect(serial, &QSerialPort::readyRead, this, &Fingerprint::onReadyRead);
+	connect(serial, &QSerialPort::bytesWritten, this, &Fingerprint::onBytesWritten);
+	
+	timeoutTimer.setSingleShot(true);
+	connect(&timeoutTimer, &QTimer::timeout, this, &Fingerprint::onTimeout);
 }
 
 
@@ -77,16 +124,8 @@ Fingerprint::~Fingerprint()
  */
 Fingerprint::Status Fingerprint::setSysPara(SystemParam param, uint8_t value)
 {
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(SETSYSPARA).append((uint8_t)param).append(value));
-	
 	QByteArray ack;
-	PacketType type=getReply(ack);
-
-	if(!(type==ACK && ack.size()==1))
-	{
-		return BADPACKET;
-	}
-	return (Status)ack.at(0);
+	return execute(CommandFrame(THEADDRESS, CMD_SETSYSPARA, uint8_t(param), value), ack);
 }
 
 
@@ -96,14 +135,12 @@ Fingerprint::Status Fingerprint::setSysPara(SystemParam param, uint8_t value)
 Fingerprint::Status Fingerprint::readSysPara(uint16_t& statusReg, uint16_t& systemID, uint16_t& librarySize, uint16_t& securityLevel,
 				   uint32_t& deviceAddress, uint16_t& sizeCode, uint16_t& nBaud)
 {
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(READSYSPARA));
-	
 	QByteArray ack;
-	PacketType type=getReply(ack);
-
-	if(!(type==ACK && ack.size()==17))
+	Status status=execute(CommandFrame(THEADDRESS, CMD_READSYSPARA), ack);
+	
+	if(ack.size()!=17)
 	{
-		return BADPACKET;
+		return status;
 	}
 	
 	statusReg = ((uint16_t)ack[1])<<8;
@@ -129,7 +166,13 @@ Fingerprint::Status Fingerprint::readSysPara(uint16_t& statusReg, uint16_t& syst
 	nBaud = ((uint16_t)ack[15])<<8;
 	nBaud |= (uint8_t)ack[16];
 	
-	return (Status)ack.at(0);
+	// keep track of the data packet size used by the sensor
+	if(status==OK && sizeCode<=3)
+	{
+		packetSize=32<<sizeCode;
+	}
+	
+	return status;
 }
 
 
@@ -138,16 +181,8 @@ Fingerprint::Status Fingerprint::readSysPara(uint16_t& statusReg, uint16_t& syst
  */
 Fingerprint::Status Fingerprint::genImage(void)
 {
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(GENIMAGE));
-	
 	QByteArray ack;
-	PacketType type=getReply(ack);
-
-	if(!(type==ACK && ack.size()==1))
-	{
-		return BADPACKET;
-	}
-	return (Status)ack.at(0);
+	return complete([this](Callback done) { genImageAsync(done); }, ack);
 }
 
 
@@ -156,16 +191,8 @@ Fingerprint::Status Fingerprint::genImage(void)
  */
 Fingerprint::Status Fingerprint::image2Tz(Slot slot)
 {	
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(IMAGE2TZ).append(slot));
-	
 	QByteArray ack;
-	PacketType type=getReply(ack);
-
-	if(!(type==ACK && ack.size()==1))
-	{
-		return BADPACKET;
-	}
-	return (Status)ack.at(0);
+	return complete([this, slot](Callback done) { image2TzAsync(slot, done); }, ack);
 }
 
 
@@ -174,16 +201,8 @@ Fingerprint::Status Fingerprint::image2Tz(Slot slot)
  */
 Fingerprint::Status Fingerprint::createModel(void)
 {
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(REGMODEL));
-	
 	QByteArray ack;
-	PacketType type=getReply(ack);
-
-	if(!(type==ACK && ack.size()==1))
-	{
-		return BADPACKET;
-	}
-	return (Status)ack.at(0);
+	return complete([this](Callback done) { createModelAsync(done); }, ack);
 }
 
 
@@ -192,16 +211,8 @@ Fingerprint::Status Fingerprint::createModel(void)
  */
 Fingerprint::Status Fingerprint::storeModel(Slot slot, uint16_t id)
 {
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(STORE).append(slot).append(id>>8).append(id & 0xFF));
-	
 	QByteArray ack;
-	PacketType type=getReply(ack);
-
-	if(!(type==ACK && ack.size()==1))
-	{
-		return BADPACKET;
-	}
-	return (Status)ack.at(0);
+	return complete([this, slot, id](Callback done) { storeModelAsync(slot, id, done); }, ack);
 }
 
 
@@ -210,16 +221,8 @@ Fingerprint::Status Fingerprint::storeModel(Slot slot, uint16_t id)
  */
 Fingerprint::Status Fingerprint::loadModel(Slot slot, uint16_t id)
 {
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(LOADCHAR).append(slot).append(id>>8).append(id & 0xFF));
-	
 	QByteArray ack;
-	PacketType type=getReply(ack);
-
-	if(!(type==ACK && ack.size()==1))
-	{
-		return BADPACKET;
-	}
-	return (Status)ack.at(0);
+	return complete([this, slot, id](Callback done) { loadModelAsync(slot, id, done); }, ack);
 }
 
 
@@ -233,27 +236,40 @@ Fingerprint::Status Fingerprint::loadModel(Slot slot, uint16_t id)
 Fingerprint::Status Fingerprint::search(Slot slot, uint16_t start_id, uint16_t count,
 										uint16_t& id, uint16_t& score)
 {
-	//qDebug() << "search()";
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(SEARCH).append(slot)
-				.append(start_id>>8).append(start_id & 0xFF).append(count>>8).append(count & 0xFF));
-	
 	QByteArray ack;
-	PacketType type=getReply(ack);
+	Status status=execute(CommandFrame(THEADDRESS, CMD_SEARCH, uint8_t(slot), start_id, count), ack);
 	
-	//qDebug() << "reply:" << ack.toHex(':');
-	
-	if(!(type==ACK && ack.size()==5))
+	id=0;
+	score=0;
+	if(ack.size()==5)
 	{
-		return BADPACKET;
+		id=uint16_t(uint8_t(ack[1]))<<8;
+		id|=uint8_t(ack[2]);
+		score=uint16_t(uint8_t(ack[3]))<<8;
+		score|=uint8_t(ack[4]);
 	}
+	return status;
+}
+
+
+/*
+ * compare the models in both slots (1:1)
+ * additional return parameter:
+ *	* match score (0 at mismatch)
+ * return value: OK if the models match, NOMATCH otherwise
+ */
+Fingerprint::Status Fingerprint::match(uint16_t& score)
+{
+	QByteArray ack;
+	Status status=execute(CommandFrame(THEADDRESS, CMD_MATCH), ack);
 	
-	id=((uint16_t)ack[1])<<8;
-	id|=(uint8_t)ack[2];
-	
-	score=((uint16_t)ack[3])<<8;
-	score|=(uint8_t)ack[4];
-	
-	return (Status)ack.at(0);
+	score=0;
+	if(ack.size()==3)
+	{
+		score=uint16_t(uint8_t(ack[1]))<<8;
+		score|=uint8_t(ack[2]);
+	}
+	return status;
 }
 
 
@@ -262,17 +278,8 @@ Fingerprint::Status Fingerprint::search(Slot slot, uint16_t start_id, uint16_t c
  */
 Fingerprint::Status Fingerprint::deleteModel(uint16_t id, uint16_t count)
 {
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(DELETE).append(id>>8).append(id & 0xFF)
-				.append(count>>8).append(count & 0xFF));
-	
 	QByteArray ack;
-	PacketType type=getReply(ack);
-
-	if(!(type==ACK && ack.size()==1))
-	{
-		return BADPACKET;
-	}
-	return (Status)ack.at(0);
+	return complete([this, id, count](Callback done) { deleteModelAsync(id, count, done); }, ack);
 }
 
 
@@ -281,16 +288,8 @@ Fingerprint::Status Fingerprint::deleteModel(uint16_t id, uint16_t count)
  */
 Fingerprint::Status Fingerprint::emptyDatabase(void)
 {
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(EMPTY));
-	
 	QByteArray ack;
-	PacketType type=getReply(ack);
-
-	if(!(type==ACK && ack.size()==1))
-	{
-		return BADPACKET;
-	}
-	return (Status)ack.at(0);
+	return execute(CommandFrame(THEADDRESS, CMD_EMPTY), ack);
 }
 
 
@@ -301,321 +300,1008 @@ Fingerprint::Status Fingerprint::emptyDatabase(void)
  */
 Fingerprint::Status Fingerprint::upChar(Slot slot, QByteArray& model)
 {	
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(UPCHAR).append(slot));
-		
-	QByteArray ack;
-	PacketType type=getReply(ack);
-
-	if(!(type==ACK && ack.size()==1))
-	{
-		return BADPACKET;
-	}
-	
-	Status status=(Status)ack.at(0);
-	if(status!=OK)
-	{
-		return status;
-	}
-	
-	
-	// data is received in multiple DATA packets, terminated by END packet
 	QByteArray data;
-	
-	while(true)
+	Status status=complete([this, slot](Callback done) { upCharAsync(slot, done); }, data);
+	if(status==OK)
 	{
-		QByteArray packet;
-		PacketType type=getReply(data);
-		
-		data.append(packet);
-		
-		if(type==END)
-		{
-			// end of data packet
-			/*if(data.size()!=TEMPSIZE)
-			{
-				qCritical() << "Fingerprint::upChar(): wrong size of data packet";
-				return BADPACKET;
-			}*/
-			break;
-		}
-		else if(type!=DATA)
-		{
-			qCritical() << "Fingerprint::upChar(): invalid packet received";
-			return BADPACKET;
-		}
-		
-		/*
-		if(data.size()>TEMPSIZE)
-		{
-			qCritical() << "Fingerprint::upChar(): to long data packet" << data.size() << ">" << TEMPSIZE;
-			return BADPACKET;
-		}
-		*/
+		model=data;
 	}
 	
-	//qDebug() << "template size:" << data.size();
-	
-	model=data;
+	//qDebug() << "template size:" << model.size();
 	
-	return OK;
+	return status;
 }
 
 /*
  * download model file to <slot>
+ * the sensor does not acknowledge the data packets, a corrupted download is reported by the next command using <slot>
  */
-Fingerprint::Status Fingerprint::downChar(Slot slot, QByteArray model)
+Fingerprint::Status Fingerprint::downChar(Slot slot, const QByteArray& model)
 {
-	writePacket(THEADDRESS, COMMAND, QByteArray().append(DOWNCHAR).append(slot));
-		
 	QByteArray ack;
-	PacketType type=getReply(ack);
-
-	if(!(type==ACK && ack.size()==1))
-	{
-		return BADPACKET;
-	}
-	
-	Status status=(Status)ack.at(0);
-	if(status!=OK)
-	{
-		return status;
-	}
+	Status status=complete([this, slot, &model](Callback done) { downCharAsync(slot, model, done); }, ack);
 	
-	// ready to send data packet
-	int pos;
-	int packetsize=128;
-	QByteArray packet;
-	
-	for(pos=0; pos+packetsize<TEMPSIZE; pos+=packetsize)
+	return status;
+}
+
+
+/*
+ * write <data> to notepad <page> (0...15), data is padded to 32 bytes
+ */
+Fingerprint::Status Fingerprint::writeNotepad(uint8_t page, const QByteArray& data)
+{
+	QByteArray ack;
+	return complete([this, page, &data](Callback done) { writeNotepadAsync(page, data, done); }, ack);
+}
+
+
+/*
+ * read notepad <page> (0...15)
+ * additional return parameter:
+ *	* content of the page (32 bytes)
+ */
+Fingerprint::Status Fingerprint::readNotepad(uint8_t page, QByteArray& data)
+{
+	QByteArray content;
+	Status status=complete([this, page](Callback done) { readNotepadAsync(page, done); }, content);
+	if(content.size()==NOTEPAD_SIZE)
 	{
-		packet=model.mid(pos, packetsize);
-		writePacket(THEADDRESS, DATA, packet);
+		data=content;
 	}
 	
-	// end of packet
-	packet=model.mid(pos, packetsize);
-	writePacket(THEADDRESS, END, packet);
-	
-	// TODO upload again to verify download
-	
-	return OK;
+	return status;
 }
 
 
-void Fingerprint::printError(Status status)
+/*
+ * read index table <page>, occupancy bitmap of library entries page*256 ... page*256+255
+ * additional return parameter:
+ *	* bitmap (32 bytes), bit 0 of byte 0 is the first entry of the page
+ */
+Fingerprint::Status Fingerprint::readIndexTable(uint8_t page, QByteArray& table)
 {
-	qWarning() << "Fingerprint Error:" << QString("0x%1").arg((int)status, 2, 16, QChar('0'));
+	QByteArray ack;
+	Status status=execute(CommandFrame(THEADDRESS, CMD_READINDEXTABLE, page), ack);
 	
-	switch(status)
+	if(ack.size()!=1+INDEX_PAGE_SIZE/8)
 	{
-		case PACKETRECIEVEERR:	qCritical()	<< "\t error when receiving data packet"; break;
-		case IMAGEFAIL:			qWarning()	<< "\t fail to enroll finger"; break;
-		case IMAGEMESS:			qWarning()	<< "\t disordered fingerprint"; break;
-		case FEATUREFAIL:		qWarning()	<< "\t too small fingerprint"; break;
-		case ENROLLMISMATCH:	qWarning()	<< "\t enroll mismatch (could not combine the 2 samples)"; break;
-		case BADPAGEID:			qCritical()	<< "\t invalid ID (out of memory)"; break;
-		case FLASHERR:			qCritical()	<< "\t error writing flash"; break;
-		case DELETEFAIL:		qCritical()	<< "\t failed to delete template"; break;
-		case DBCLEARFAIL:		qCritical()	<< "\t failed to clear database"; break;
-		case UPLOADFEATUREFAIL:	qCritical()	<< "\t error when uploading template"; break;
-		case BADPACKET:			qCritical()	<< "\t packet error"; break;
-		default:				qCritical()	<< "\t unknown error"; break;
+		return status;
 	}
+	
+	table=ack.mid(1);
+	
+	return status;
 }
 
-/************************************************************/
-/*					private functions:						*/
-/************************************************************/
 
-bool Fingerprint::tryToOpenSerial()
+/*
+ * read occupancy of all library entries below the capacity of <ids>
+ * additional return parameter:
+ *	* occupied IDs
+ */
+Fingerprint::Status Fingerprint::readIndex(SlotBitmap& ids)
 {
-	/*
-	// list available serial ports
-	auto ports = QSerialPortInfo::availablePorts();
-	for(auto p : ports)
-	{
-		qDebug() << p.portName() << p.description();
-	}
-	*/
-	
-	// check for errors and clear them
-	if(serial->error()!=QSerialPort::NoError)
-	{
-		qWarning() << "Fingerprint: SerialPort Error:" << serial->error() << serial->errorString();
-		serial->clearError();
-		serial->close();
-	}
+	ids.clear();
 	
-	// try to open
-	if(!serial->isOpen())
+	for(int page=0; page*INDEX_PAGE_SIZE<ids.capacity(); page++)
 	{
-		if(!serial->open(QIODevice::ReadWrite /*| QIODevice::Unbuffered*/))
+		QByteArray table;
+		Status status=readIndexTable(uint8_t(page), table);
+		if(status!=OK)
 		{
-			qCritical() << "Fingerprint: cannot open serial port" << serial->portName() << "error:" << serial->error() << serial->errorString();
-			return false;
+			return status;
 		}
-		serial->setBaudRate(QSerialPort::Baud57600);
+		
+		ids.insertBytes(page*INDEX_PAGE_SIZE, table);
 	}
 	
-	//qDebug() << "Fingerprint: serial port" << serial->portName() << "open.";
-	
-	return true;
+	return OK;
 }
 
 
-bool Fingerprint::writePacket(uint32_t addr, PacketType type, QByteArray data)
+/*
+ * check if the sensor responds
+ * the system parameters are read instead of sending HANDSHAKE, as 0x17 is used as port control
+ * (port on/off) by some modules, the long ACK also makes a better test of the link
+ */
+Fingerprint::Status Fingerprint::handshake(void)
 {
-	if(!tryToOpenSerial())
-		return false;
-	
-	uint16_t pac_len=data.size()+2;		// length of data including checksum
-	uint16_t sum=0;						// checksum
-	
-	QByteArray packet;
-	
-	// write packet header
-	packet.append((uint8_t)(STARTCODE >> 8));
-	packet.append((uint8_t)STARTCODE);
-	packet.append((uint8_t)(addr >> 24));
-	packet.append((uint8_t)(addr >> 16));
-	packet.append((uint8_t)(addr >> 8));
-	packet.append((uint8_t)(addr));
-	packet.append((uint8_t)type);
-	packet.append((uint8_t)(pac_len >> 8));
-	packet.append((uint8_t)(pac_len));
+	QByteArray ack;
+	return execute(CommandFrame(THEADDRESS, CMD_READSYSPARA), ack);
+}
 
-	sum += (pac_len>>8) + (pac_len&0xFF) + (uint8_t)type;
-	
-	// write data and calc checksum
-	for(int i=0; i<data.size(); i++)
+
+/*
+ * raise the baud rate of the serial link to the highest rate (up to MAX_BAUD) that passes verification
+ * call this after start()
+ */
+bool Fingerprint::negotiateBaudRate()
+{
+	// find the baud rate the sensor is using, start with the last known one
+	if(!verifyLink() && !probeBaudRate())
 	{
-		packet.append(data[i]);
-		sum += data[i];
+		qCritical() << "Fingerprint: no response from sensor at any baud rate";
+		return false;
 	}
 	
-	// write checksum
-	packet.append((uint8_t)(sum>>8));
-	packet.append((uint8_t)sum);
-	
-	// send
-	if(serial->write(packet)!=packet.size())
+	const int rates[]={115200, 57600, 38400, 19200};
+	for(int rate : rates)
 	{
-		qCritical() << "Fingerprint: could not send serial packet.";
-		return false;
+		if(rate<=baud)
+		{
+			break;
+		}
+		if(rate<=MAX_BAUD && switchBaudRate(rate))
+		{
+			break;
+		}
 	}
 	
-	QThread::msleep(10);
+	saveBaudRate();
+	qDebug() << "Fingerprint: serial link running at" << baud << "baud";
 	
 	return true;
 }
 
 
-
 /*
- * wait for a packet and receive it
- * data (return parameter): received packet content
- * return value: received type of packet, NONE in case of error
+ * set the largest data packet size (up to MAX_PACKET_SIZE) supported by the sensor,
+ * it is used for template and image transfers in both directions
  */
-Fingerprint::PacketType Fingerprint::getReply(QByteArray& data)
+bool Fingerprint::negotiatePacketSize()
 {
-	if(!tryToOpenSerial())
-		return NONE;
-	
-	// packet format
-	//  0      1      2     3     4     5     6     7    8
-	// {START, START, ADDR, ADDR, ADDR, ADDR, TYPE, LEN, LEN, DATA..., SUM, SUM}
+	uint16_t statusReg, systemID, librarySize, securityLevel, sizeCode, nBaud;
+	uint32_t deviceAddress;
 	
-	uint16_t sum=0;			// calculated checksum of type, len and data
-	
-	QByteArray buffer;		// serial receive buffer
-
-	while(true)
+	// size code: 0=32, 1=64, 2=128, 3=256 bytes
+	for(int code=3; code>=0; code--)
 	{
-		// wait for data
-		if(!serial->waitForReadyRead(SERIAL_TIMEOUT*1000))
-		{
-			qCritical() << "Fingerprint: serial port timeout";
-			return NONE;
-		}
-		
-		// append data to receive buffer
-		buffer.append(serial->readAll());
-		
-		//qDebug() << "getReply: buffer (size:" << buffer.size() << "):" << hex << buffer.toHex(':');
-		
-		bool startCodeReceived=false;
-		
-		// check if there is enough data for the header
-		while(buffer.size()>=9)
+		if((32<<code) > MAX_PACKET_SIZE)
 		{
-			// check startcode
-			uint16_t startCode = (((uint16_t)buffer[0])<<8) | ((uint16_t)buffer[1]);
-			if(startCode == STARTCODE)
-			{
-				startCodeReceived=true;
-				break;
-			}
-			else
-			{
-				buffer.remove(0, 1);	// invalid startcode, remove first byte and try again
-			}
+			continue;
 		}
 		
-		if(!startCodeReceived)
+		Status status=setSysPara(SIZE_CODE, uint8_t(code));
+		if(status!=OK)
 		{
-			continue;	// read more data, try again
+			printError(status);
+			continue;
 		}
 		
-		// startcode received, buffer.size() >= 9
-		
-		// check packet type
-		PacketType type=(PacketType)buffer.at(6);
-		if(!(type==COMMAND || type==DATA || type==ACK || type==END))
+		// read back (updates packetSize), some modules accept the command but ignore the value
+		status=readSysPara(statusReg, systemID, librarySize, securityLevel, deviceAddress, sizeCode, nBaud);
+		if(status==OK && sizeCode==code)
 		{
-			qCritical() << "Fingerprint: invalid packet type received:" << type;
-			return NONE;
+			break;
 		}
+	}
+	
+	qDebug() << "Fingerprint: data packet size" << packetSize << "bytes";
+	return packetSize==qMin(MAX_PACKET_SIZE, 256);
+}
 
-		sum = 0;
-		sum+=(uint8_t)buffer[6];
 
-		// data length (without checksum)
-		uint16_t len = (((uint16_t)(buffer[7])<<8) | (uint8_t)buffer[8]) - 2;
-		
-		//qDebug() << len;
-		sum+=(uint8_t)buffer[7];
-		sum+=(uint8_t)buffer[8];
-		
-		// check if there is enough data for the packet
-		if(buffer.size() < 9+len+2)
-		{
-			continue;	// read more data, try again
-		}
-		
-		// read packet data
-		for(int i=0; i<len; i++)
-		{
-			uint8_t d=(uint8_t)buffer[9+i];
-			data.append(d);
-			sum+=d;
-		}
-		
-		//qDebug() << hex << (uint8_t)buffer[9+len];
-		//qDebug() << hex << (uint8_t)buffer[9+len+1];
-		
-		// read checksum
-		uint16_t checksum = (((uint16_t)buffer[9+len])<<8) | (uint8_t)buffer[9+len+1];
-		
-		if(sum!=checksum)
-		{
-			qCritical() << "Fingerprint: checksum error:" << sum << "!=" << checksum;
-			return NONE;
-		}
-		
-		QThread::msleep(10);
-		
-		// checksum OK, packet is valid
-		return type;
+int Fingerprint::dataPacketSize() const
+{
+	return packetSize;
+}
+
+
+/*
+ * true if the link shows repeated checksum errors or timeouts
+ */
+bool Fingerprint::linkDegraded() const
+{
+	return linkErrors>=LINK_ERROR_LIMIT && baud>DEFAULT_BAUD;
+}
+
+
+/*
+ * go back to the default baud rate after repeated errors
+ */
+bool Fingerprint::fallBack()
+{
+	qWarning() << "Fingerprint: serial link degraded at" << baud << "baud, falling back to" << DEFAULT_BAUD << "baud";
+	
+	// the sensor may or may not understand this
+	setSysPara(N_BAUD, DEFAULT_BAUD/9600);
+	setHostBaudRate(DEFAULT_BAUD);
+	
+	bool ok=verifyLink() || probeBaudRate();
+	if(ok && baud>DEFAULT_BAUD)
+	{
+		// the sensor ignored the command, try again at the rate it is using
+		switchBaudRate(DEFAULT_BAUD);
+	}
+	
+	if(ok && baud<=DEFAULT_BAUD)
+	{
+		saveBaudRate();
+	}
+	else if(ok)
+	{
+		// the degraded rate is not saved, the next start negotiates again
+		qWarning() << "Fingerprint: sensor stays at" << baud << "baud";
 	}
+	linkErrors=0;
+	
+	return ok;
+}
+
+
+int Fingerprint::baudRate() const
+{
+	return baud;
 }
 
+
+/************************************************************/
+/*					asynchronous commands:					*/
+/************************************************************/
+
+/*
+ * generate image of finger
+ */
+void Fingerprint::genImageAsync(Callback done)
+{
+	submit(CommandFrame(THEADDRESS, CMD_GENIMAGE), done);
+}
+
+
+/*
+ * generate character file from image and store in <slot>
+ */
+void Fingerprint::image2TzAsync(Slot slot, Callback done)
+{
+	submit(CommandFrame(THEADDRESS, CMD_IMAGE2TZ, uint8_t(slot)), done);
+}
+
+
+/*
+ * use character files in both slots to create model and store back in both slots
+ */
+void Fingerprint::createModelAsync(Callback done)
+{
+	submit(CommandFrame(THEADDRESS, CMD_REGMODEL), done);
+}
+
+
+/*
+ * store model from <slot> in library at <id>
+ */
+void Fingerprint::storeModelAsync(Slot slot, uint16_t id, Callback done)
+{
+	submit(CommandFrame(THEADDRESS, CMD_STORE, uint8_t(slot), id), done);
+}
+
+
+/*
+ * load model from library at <id> into <slot>
+ */
+void Fingerprint::loadModelAsync(Slot slot, uint16_t id, Callback done)
+{
+	submit(CommandFrame(THEADDRESS, CMD_LOADCHAR, uint8_t(slot), id), done);
+}
+
+
+/*
+ * search the library for a model that matches the one in <slot>, see search()
+ * <done> is called with the id of the matching model and the match score
+ */
+void Fingerprint::searchAsync(Slot slot, uint16_t start_id, uint16_t count, SearchCallback done)
+{
+	submit(CommandFrame(THEADDRESS, CMD_SEARCH, uint8_t(slot), start_id, count), [done](Status status, const QByteArray& ack)
+	{
+		uint16_t id=0;
+		uint16_t score=0;
+		if(ack.size()==5)
+		{
+			id=uint16_t(uint8_t(ack[1]))<<8;
+			id|=uint8_t(ack[2]);
+			score=uint16_t(uint8_t(ack[3]))<<8;
+			score|=uint8_t(ack[4]);
+		}
+		done(status, id, score);
+	});
+}
+
+
+/*
+ * compare the models in both slots (1:1), see match()
+ * <done> is called with the match score
+ */
+void Fingerprint::matchAsync(MatchCallback done)
+{
+	submit(CommandFrame(THEADDRESS, CMD_MATCH), [done](Status status, const QByteArray& ack)
+	{
+		uint16_t score=0;
+		if(ack.size()==3)
+		{
+			score=uint16_t(uint8_t(ack[1]))<<8;
+			score|=uint8_t(ack[2]);
+		}
+		done(status, score);
+	});
+}
+
+
+/*
+ * delete <count> models from library starting with <id>
+ */
+void Fingerprint::deleteModelAsync(uint16_t id, uint16_t count, Callback done)
+{
+	submit(CommandFrame(THEADDRESS, CMD_DELETE, id, count), done);
+}
+
+
+/*
+ * upload model file from <slot>, <done> is called with the model
+ */
+void Fingerprint::upCharAsync(Slot slot, Callback done)
+{
+	// data is received in multiple DATA packets, terminated by END packet
+	submitUpload(CommandFrame(THEADDRESS, CMD_UPCHAR, uint8_t(slot)), done);
+}
+
+
+/*
+ * download model file to <slot>
+ */
+void Fingerprint::downCharAsync(Slot slot, const QByteArray& model, Callback done)
+{
+	submitDownload(CommandFrame(THEADDRESS, CMD_DOWNCHAR, uint8_t(slot)), model, done);
+}
+
+
+/*
+ * write <data> to notepad <page> (0...15), data is padded to 32 bytes
+ */
+void Fingerprint::writeNotepadAsync(uint8_t page, const QByteArray& data, Callback done)
+{
+	if(page>=NOTEPAD_PAGES || data.size()>NOTEPAD_SIZE)
+	{
+		done(NOTEPADERR, QByteArray());
+		return;
+	}
+	
+	// the content is padded by the frame
+	submit(CommandFrame(THEADDRESS, CMD_WRITENOTEPAD, page, data), done);
+}
+
+
+/*
+ * read notepad <page> (0...15), <done> is called with the content of the page (32 bytes)
+ */
+void Fingerprint::readNotepadAsync(uint8_t page, Callback done)
+{
+	if(page>=NOTEPAD_PAGES)
+	{
+		done(NOTEPADERR, QByteArray());
+		return;
+	}
+	
+	submit(CommandFrame(THEADDRESS, CMD_READNOTEPAD, page), [done](Status status, const QByteArray& ack)
+	{
+		done(status, ack.size()==1+NOTEPAD_SIZE ? ack.mid(1) : QByteArray());
+	});
+}
+
+
+/*
+ * run <steps> one after the other, each step is started when the previous one completed with OK
+ * <done> is called with the result of the last step or of the first step that failed
+ */
+void Fingerprint::sequence(QList<Step> steps, Callback done)
+{
+	if(steps.isEmpty())
+	{
+		done(OK, QByteArray());
+		return;
+	}
+	
+	Step step=steps.takeFirst();
+	step([this, steps, done](Status status, const QByteArray& reply)
+	{
+		if(status!=OK || steps.isEmpty())
+		{
+			done(status, reply);
+			return;
+		}
+		sequence(steps, done);
+	});
+}
+
+
+/*
+ * run <step> and block until it is completed
+ * additional return parameter:
+ *	* reply of the step
+ */
+Fingerprint::Status Fingerprint::complete(const Step& step, QByteArray& reply)
+{
+	Completion completion={false, BADPACKET, &reply};
+	Completion* c=&completion;
+	
+	step([c](Status status, const QByteArray& data)
+	{
+		c->status=status;
+		*c->reply=data;
+		c->finished=true;
+	});
+	waitFor(completion.finished);
+	
+	return completion.status;
+}
+
+
+void Fingerprint::printError(Status status)
+{
+	qWarning() << "Fingerprint Error:" << QString("0x%1").arg((int)status, 2, 16, QChar('0'));
+	
+	switch(status)
+	{
+		case PACKETRECIEVEERR:	qCritical()	<< "\t error when receiving data packet"; break;
+		case IMAGEFAIL:			qWarning()	<< "\t fail to enroll finger"; break;
+		case IMAGEMESS:			qWarning()	<< "\t disordered fingerprint"; break;
+		case FEATUREFAIL:		qWarning()	<< "\t too small fingerprint"; break;
+		case ENROLLMISMATCH:	qWarning()	<< "\t enroll mismatch (could not combine the 2 samples)"; break;
+		case NOMATCH:			qWarning()	<< "\t templates do not match"; break;
+		case BADPAGEID:			qCritical()	<< "\t invalid ID (out of memory)"; break;
+		case FLASHERR:			qCritical()	<< "\t error writing flash"; break;
+		case DELETEFAIL:		qCritical()	<< "\t failed to delete template"; break;
+		case DBCLEARFAIL:		qCritical()	<< "\t failed to clear database"; break;
+		case UPLOADFEATUREFAIL:	qCritical()	<< "\t error when uploading template"; break;
+		case NOTEPADERR:		qCritical()	<< "\t error reading/writing notepad"; break;
+		case BADPACKET:			qCritical()	<< "\t packet error"; break;
+		case TIMEOUT:			qCritical()	<< "\t serial port timeout"; break;
+		default:				qCritical()	<< "\t unknown error"; break;
+	}
+}
+
+
+/************************************************************/
+/*					packet engine:							*/
+/************************************************************/
+
+/*
+ * queue a command that is answered by a single ACK packet with <ackSize> bytes of content
+ * <done> is called with the status code and the ACK content
+ */
+void Fingerprint::submit(const CommandFrame& command, Callback done)
+{
+	enqueue({command, 0, ACK_ONLY, QByteArray(), std::move(done)});
+}
+
+
+/*
+ * queue a command that is answered by an ACK packet followed by DATA packets, terminated by an END packet
+ * <done> is called with the collected data
+ */
+void Fingerprint::submitUpload(const CommandFrame& command, Callback done)
+{
+	enqueue({command, 0, RECEIVE_DATA, QByteArray(), std::move(done)});
+}
+
+
+/*
+ * queue a command that is answered by an ACK packet, afterwards <data> is sent in DATA packets, terminated by an END packet
+ * <done> is called as soon as all data is written to the serial port, the next command waits until the data was transmitted
+ */
+void Fingerprint::submitDownload(const CommandFrame& command, const QByteArray& data, Callback done)
+{
+	enqueue({command, 0, SEND_DATA, data, std::move(done)});
+}
+
+
+bool Fingerprint::isIdle() const
+{
+	return state==IDLE && requests.isEmpty();
+}
+
+
+/*
+ * drive the packet engine without an event loop
+ * blocks until the active request makes progress or times out
+ */
+void Fingerprint::processEvents()
+{
+	if(state==IDLE)
+	{
+		return;
+	}
+	
+	int remaining=requests.head().timeout - int(requestTime.elapsed());
+	if(remaining<=0)
+	{
+		onTimeout();
+		return;
+	}
+	
+	// the wait functions emit readyRead()/bytesWritten() which drive the engine
+	if(state==SEND)
+	{
+		serial->waitForBytesWritten(remaining);
+	}
+	else
+	{
+		serial->waitForReadyRead(remaining);
+	}
+}
+
+
+/************************************************************/
+/*					private functions:						*/
+/************************************************************/
+
+/*
+ * send command and block until the ACK was received
+ * ack (return parameter): ACK content, empty if the ACK was invalid
+ */
+Fingerprint::Status Fingerprint::execute(const CommandFrame& command, QByteArray& ack)
+{
+	Completion completion={false, BADPACKET, &ack};
+	Completion* c=&completion;
+	
+	submit(command, [c](Status status, const QByteArray& reply)
+	{
+		c->status=status;
+		*c->reply=reply;
+		c->finished=true;
+	});
+	waitFor(completion.finished);
+	
+	return completion.status;
+}
+
+
+/*
+ * process serial port events until <finished> is set by a completion callback
+ */
+void Fingerprint::waitFor(const bool& finished)
+{
+	while(!finished)
+	{
+		processEvents();
+	}
+}
+
+
+void Fingerprint::enqueue(Request&& request)
+{
+	requests.enqueue(std::move(request));
+	
+	// the timeout is taken when the request is queued, probeBaudRate() uses a short one
+	Request& queued=requests.last();
+	queued.timeout=qMax(requestTimeout, int(queued.command.descriptor().timeout));
+	
+	if(state==IDLE)
+	{
+		startNext();
+	}
+}
+
+
+/*
+ * start the request at the head of the queue
+ */
+void Fingerprint::startNext()
+{
+	if(state!=IDLE || requests.isEmpty())
+	{
+		return;
+	}
+	
+	// the data of a download may still be on the wire, the sensor has no reply to wait for
+	if(settleDelay>0)
+	{
+		int wait=settleDelay - int(settleTime.elapsed());
+		settleDelay=0;
+		if(wait>0)
+		{
+			QThread::msleep(wait);
+		}
+	}
+	
+	rxData.resize(0);
+	requestTime.start();
+	state=WAIT_ACK;
+	
+	// without an event loop processEvents() checks the timeout, (re)starting a timer allocates
+	if(thread()->loopLevel()>0)
+	{
+		timeoutTimer.start(requests.head().timeout);
+	}
+	
+	if(!writeFrame(requests.head().command))
+	{
+		finish(BADPACKET, QByteArray());
+	}
+}
+
+
+/*
+ * complete the active request and start the next one
+ */
+void Fingerprint::finish(Status status, const QByteArray& reply)
+{
+	if(requests.isEmpty())
+	{
+		state=IDLE;
+		return;
+	}
+	
+	Request request=requests.dequeue();
+	timeoutTimer.stop();
+	state=IDLE;
+	
+	if(status==BADPACKET || status==TIMEOUT)
+	{
+		linkErrors++;
+	}
+	else
+	{
+		linkErrors=0;
+	}
+	
+	if(request.done)
+	{
+		request.done(status, reply);
+	}
+	
+	startNext();
+}
+
+
+/*
+ * advance the request state machine with a received packet
+ */
+void Fingerprint::handlePacket(PacketType type, const QByteArray& data)
+{
+	switch(state)
+	{
+		case IDLE:
+		{
+			qWarning() << "Fingerprint: unexpected packet received, type:" << type;
+			break;
+		}
+			
+		case WAIT_ACK:
+		{
+			const Request& request=requests.head();
+			
+			if(!(type==ACK && data.size()==request.command.descriptor().ackSize))
+			{
+				finish(BADPACKET, QByteArray());
+				break;
+			}
+			
+			Status status=(Status)data.at(0);
+			if(status!=OK || request.transfer==ACK_ONLY)
+			{
+				finish(status, data);
+			}
+			else if(request.transfer==RECEIVE_DATA)
+			{
+				state=RECEIVE;
+				requestTime.start();
+				if(timeoutTimer.isActive())
+				{
+					timeoutTimer.start(request.timeout);
+				}
+			}
+			else
+			{
+				// ready to send data packets
+				state=SEND;
+				requestTime.start();
+				if(timeoutTimer.isActive())
+				{
+					timeoutTimer.start(request.timeout);
+				}
+				
+				// the packets are encoded directly from the shared data
+				const char* p=request.data.constData();
+				int pos;
+				
+				for(pos=0; pos+packetSize<request.data.size(); pos+=packetSize)
+				{
+					writePacket(THEADDRESS, DATA, p+pos, packetSize);
+				}
+				
+				// end of packet
+				if(!writePacket(THEADDRESS, END, p+pos, request.data.size()-pos))
+				{
+					finish(BADPACKET, QByteArray());
+				}
+			}
+			break;
+		}
+			
+		case RECEIVE:
+		{
+			rxData.append(data);
+			
+			if(type==END)
+			{
+				// end of data packet
+				finish(OK, rxData);
+			}
+			else if(type!=DATA)
+			{
+				qCritical() << "Fingerprint::upChar(): invalid packet received";
+				finish(BADPACKET, QByteArray());
+			}
+			break;
+		}
+			
+		case SEND:
+		{
+			qWarning() << "Fingerprint: unexpected packet received while sending data, type:" << type;
+			break;
+		}
+	}
+}
+
+
+void Fingerprint::onReadyRead()
+{
+	while(true)
+	{
+		// read directly into the receive buffer
+		int space;
+		char* p=framer.writePointer(space);
+		qint64 n=serial->read(p, space);
+		if(n<=0)
+		{
+			break;
+		}
+		framer.commit(int(n));
+		
+		//qDebug() << "onReadyRead:" << n << "bytes, buffer size:" << framer.size();
+		
+		// process all complete packets, partial packets stay in the buffer
+		uint8_t type;
+		PacketFramer::Result result;
+		while((result=framer.next(type, rxPacket))!=PacketFramer::NEED_MORE)
+		{
+			if(result==PacketFramer::BAD_CHECKSUM)
+			{
+				qCritical() << "Fingerprint: checksum error, packet type:" << type;
+				if(state==WAIT_ACK || state==RECEIVE)
+				{
+					finish(BADPACKET, QByteArray());
+				}
+				continue;
+			}
+			
+			handlePacket((PacketType)type, rxPacket);
+		}
+	}
+}
+
+
+void Fingerprint::onBytesWritten()
+{
+	if(state==SEND && serial->bytesToWrite()==0)
+	{
+		// all data packets are passed to the tty, no reply is expected: the next command waits
+		// for the transmission time of the packets plus DOWNLOAD_SETTLE
+		int size=requests.head().data.size();
+		int bytes=size + qMax((size+packetSize-1)/packetSize, 1)*PACKET_OVERHEAD;
+		settleDelay=int(qint64(bytes)*10*1000/qMax(baud, 1)) + DOWNLOAD_SETTLE;
+		settleTime.start();
+		
+		finish(OK, QByteArray());
+	}
+}
+
+
+void Fingerprint::onTimeout()
+{
+	if(state==IDLE)
+	{
+		return;
+	}
+	
+	qCritical() << "Fingerprint: serial port timeout";
+	
+	// drop partial packets of the aborted request
+	framer.clear();
+	finish(TIMEOUT, QByteArray());
+}
+
+
+/*
+ * switch sensor and host to <rate>
+ * return value: false if the link does not work at the new rate, the old rate is restored in this case
+ */
+bool Fingerprint::switchBaudRate(int rate)
+{
+	int old=baud;
+	
+	qDebug() << "Fingerprint: try" << rate << "baud";
+	
+	// the ACK is sent at the old rate
+	Status status=setSysPara(N_BAUD, uint8_t(rate/9600));
+	if(status!=OK)
+	{
+		printError(status);
+		return false;
+	}
+	
+	setHostBaudRate(rate);
+	if(verifyLink())
+	{
+		return true;
+	}
+	
+	// sensor did not switch (or the link is not reliable at the new rate), go back
+	setHostBaudRate(old);
+	if(!verifyLink())
+	{
+		// sensor switched, but the link does not work, tell it to go back
+		setHostBaudRate(rate);
+		setSysPara(N_BAUD, uint8_t(old/9600));
+		setHostBaudRate(old);
+		
+		if(!verifyLink() && !probeBaudRate())
+		{
+			qCritical() << "Fingerprint: lost connection to sensor while switching baud rate";
+			return false;
+		}
+	}
+	
+	// make sure the new rate does not take effect at the next power up
+	if(baud==old)
+	{
+		setSysPara(N_BAUD, uint8_t(old/9600));
+	}
+	
+	return false;
+}
+
+
+/*
+ * search the baud rate the sensor is using
+ */
+bool Fingerprint::probeBaudRate()
+{
+	// common rates first, then all other rates supported by the sensor (N*9600)
+	QList<int> rates={DEFAULT_BAUD, 115200, 9600, 19200, 38400};
+	for(int n=1; n<=12; n++)
+	{
+		if(!rates.contains(n*9600))
+		{
+			rates.append(n*9600);
+		}
+	}
+	
+	requestTimeout=PROBE_TIMEOUT;
+	
+	bool found=false;
+	for(int rate : rates)
+	{
+		setHostBaudRate(rate);
+		if(handshake()==OK)
+		{
+			found=true;
+			break;
+		}
+	}
+	
+	requestTimeout=SERIAL_TIMEOUT*1000;
+	
+	return found && verifyLink();
+}
+
+
+/*
+ * verify the link with a series of handshakes
+ */
+bool Fingerprint::verifyLink()
+{
+	for(int i=0; i<VERIFY_COUNT; i++)
+	{
+		if(handshake()!=OK)
+		{
+			return false;
+		}
+	}
+	linkErrors=0;
+	return true;
+}
+
+
+bool Fingerprint::setHostBaudRate(int rate)
+{
+	baud=rate;
+	
+	// drop everything that was received at the old rate
+	framer.clear();
+	serial->clear();
+	
+	return serial->setBaudRate(rate);
+}
+
+
+void Fingerprint::saveBaudRate()
+{
+	QSettings stateFile(STATE_FILE, QSettings::IniFormat);
+	stateFile.setValue("serial/baud", baud);
+}
+
+
+bool Fingerprint::tryToOpenSerial()
+{
+	/*
+	// list available serial ports
+	auto ports = QSerialPortInfo::availablePorts();
+	for(auto p : ports)
+	{
+		qDebug() << p.portName() << p.description();
+	}
+	*/
+	
+	// check for errors and clear them
+	if(serial->error()!=QSerialPort::NoError)
+	{
+		qWarning() << "Fingerprint: SerialPort Error:" << serial->error() << serial->errorString();
+		serial->clearError();
+		serial->close();
+	}
+	
+	// try to open
+	if(!serial->isOpen())
+	{
+		if(!serial->open(QIODevice::ReadWrite /*| QIODevice::Unbuffered*/))
+		{
+			qCritical() << "Fingerprint: cannot open serial port" << serial->portName() << "error:" << serial->error() << serial->errorString();
+			return false;
+		}
+		serial->setBaudRate(baud);
+	}
+	
+	//qDebug() << "Fingerprint: serial port" << serial->portName() << "open.";
+	
+	return true;
+}
+
+
+/*
+ * encode a packet with <size> bytes of <data> on the stack and send it
+ */
+bool Fingerprint::writePacket(uint32_t addr, PacketType type, const char* data, int size)
+{
+	if(size>PacketFramer::MAX_PACKET_LEN-2)
+	{
+		qCritical() << "Fingerprint: packet too large:" << size;
+		return false;
+	}
+	
+	char packet[CommandFrame::HEADER_SIZE+PacketFramer::MAX_PACKET_LEN];
+	int n=CommandFrame::encode(packet, addr, uint8_t(type), data, size);
+	
+	return send(packet, n);
+}
+
+
+bool Fingerprint::writeFrame(const CommandFrame& frame)
+{
+	return send(frame.data(), frame.size());
+}
+
+
+bool Fingerprint::send(const char* packet, int size)
+{
+	if(!tryToOpenSerial())
+		return false;
+	
+	// send, the data is written as soon as the serial port is ready (signaled by bytesWritten())
+	if(serial->write(packet, size)!=size)
+	{
+		qCritical() << "Fingerprint: could not send serial packet.";
+		return false;
+	}
+	
+	return true;
+}
@@ -29,6 +29,15 @@
 
 #include <QObject>
 #include <QSerialPort>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include <functional>
+
+#include "packetframer.h"
+#include "commandframe.h"
+#include "ringqueue.h"
+#include "slotbitmap.h"
 
 
 class Fingerprint : public QObject
@@ -49,18 +58,51 @@ public:
 	// command codes
 	enum Command {GENIMAGE=0x01, IMAGE2TZ=0x02, MATCH=0x03, SEARCH=0x04, REGMODEL=0x05, STORE=0x06, LOADCHAR=0x07, UPCHAR=0x08, DOWNCHAR=0x09,
 				  UPIMAGE=0x0A, DOWNIMAGE=0x0B, DELETE=0x0C, EMPTY=0x0D, SETSYSPARA=0x0E, READSYSPARA=0x0F/*, VERIFYPASSWORD=0x13*/, RANDOM=0x14,
-				  SETADDR=0x15, HANDSHAKE=0x17, WRITENOTEPAD=0x18, READNOTEPAD=0x19/*, HISPEEDSEARCH=0x1B*/, TEMPLATECOUNT=0x1D};
+				  SETADDR=0x15, HANDSHAKE=0x17, WRITENOTEPAD=0x18, READNOTEPAD=0x19/*, HISPEEDSEARCH=0x1B*/, TEMPLATECOUNT=0x1D,
+				  READINDEXTABLE=0x1F};	// READINDEXTABLE is not in the ZFM-20 datasheet, but supported by compatible modules (R30x, DY-50)
 	
 	enum SystemParam {N_BAUD=4, SECURITY_LEVEL=5, SIZE_CODE=6};
 	
+	static const int NOTEPAD_PAGES=16;		// number of notepad pages
+	static const int NOTEPAD_SIZE=32;		// size of a notepad page in bytes
+	static const int INDEX_PAGE_SIZE=256;	// number of library entries per index table page
+	
+	// completion callback of an asynchronous request, reply contains the ACK content (or the uploaded data)
+	typedef std::function<void(Status status, const QByteArray& reply)> Callback;
+	typedef std::function<void(Status status, uint16_t id, uint16_t score)> SearchCallback;
+	typedef std::function<void(Status status, uint16_t score)> MatchCallback;
+	
+	// step of a command sequence, submits its commands and calls <next> on completion
+	typedef std::function<void(Callback next)> Step;
+	
 	Fingerprint();
 	~Fingerprint();
 	
 	// call this at start
 	bool start();
+	
+	
+	// asynchronous packet engine
+	// requests are queued and processed one after the other, callbacks are called on completion
+	void submit(const CommandFrame& command, Callback done);						// command followed by ACK
+	void submitUpload(const CommandFrame& command, Callback done);					// command followed by ACK and DATA...END packets
+	void submitDownload(const CommandFrame& command, const QByteArray& data, Callback done);	// command followed by ACK, then send DATA...END packets
+	bool isIdle() const;
+	void processEvents();		// block until the next serial port event (or timeout) and process it
+	void sequence(QList<Step> steps, Callback done);	// run steps one after the other, stop at the first error
+	Status complete(const Step& step, QByteArray& reply);	// run step and block until it is completed
 
 
+	// serial link
+	bool negotiateBaudRate();
+	bool linkDegraded() const;
+	bool fallBack();
+	int baudRate() const;
+	bool negotiatePacketSize();
+	int dataPacketSize() const;
+	
 	// commands
+	Status handshake(void);
 	Status setSysPara(SystemParam param, uint8_t value);
 	Status readSysPara(uint16_t& statusReg, uint16_t& systemID, uint16_t& librarySize, uint16_t& securityLevel,
 					   uint32_t& deviceAddress, uint16_t& sizeCode, uint16_t& nBaud);
@@ -72,10 +114,29 @@ public:
 	Status storeModel(Slot slot, uint16_t id);
 	Status loadModel(Slot slot, uint16_t id);
 	Status search(Slot slot, uint16_t start_id, uint16_t count, uint16_t& id, uint16_t& score);
+	Status match(uint16_t& score);
 	Status deleteModel(uint16_t id, uint16_t count);
 	Status emptyDatabase(void);
 	Status upChar(Slot slot, QByteArray& model);
-	Status downChar(Slot slot, QByteArray model);
+	Status downChar(Slot slot, const QByteArray& model);
+	Status writeNotepad(uint8_t page, const QByteArray& data);
+	Status readNotepad(uint8_t page, QByteArray& data);
+	Status readIndexTable(uint8_t page, QByteArray& table);
+	Status readIndex(SlotBitmap& ids);
+	
+	// asynchronous commands, queued behind the pending requests
+	void genImageAsync(Callback done);
+	void image2TzAsync(Slot slot, Callback done);
+	void createModelAsync(Callback done);
+	void storeModelAsync(Slot slot, uint16_t id, Callback done);
+	void loadModelAsync(Slot slot, uint16_t id, Callback done);
+	void searchAsync(Slot slot, uint16_t start_id, uint16_t count, SearchCallback done);
+	void matchAsync(MatchCallback done);
+	void deleteModelAsync(uint16_t id, uint16_t count, Callback done);
+	void upCharAsync(Slot slot, Callback done);
+	void downCharAsync(Slot slot, const QByteArray& model, Callback done);
+	void writeNotepadAsync(uint8_t page, const QByteArray& data, Callback done);
+	void readNotepadAsync(uint8_t page, Callback done);
 	//Status getTemplateCount(void);
 	
 	void printError(Status status);
@@ -83,15 +144,71 @@ public:
 	
 private:
 	
+	enum Transfer {ACK_ONLY, RECEIVE_DATA, SEND_DATA};		// data phase following the ACK of a request
+	enum EngineState {IDLE, WAIT_ACK, RECEIVE, SEND};		// state of the packet engine
+	
+	struct Request
+	{
+		CommandFrame command;	// encoded command packet
+		int timeout;			// (milliseconds)
+		Transfer transfer;
+		QByteArray data;		// data to send (SEND_DATA), shared with the caller
+		Callback done;
+	};
+	
+	// result of a blocking request, the completion callback only captures its address so it is not allocated
+	struct Completion
+	{
+		bool finished;
+		Status status;
+		QByteArray* reply;
+	};
+	
 	bool tryToOpenSerial();	
-	bool writePacket(uint32_t addr, PacketType type, QByteArray data);
-	PacketType getReply(QByteArray& data);
+	bool switchBaudRate(int rate);
+	bool probeBaudRate();
+	bool verifyLink();
+	bool setHostBaudRate(int rate);
+	void saveBaudRate();
+	bool writePacket(uint32_t addr, PacketType type, const char* data, int size);
+	bool writeFrame(const CommandFrame& frame);
+	bool send(const char* packet, int size);
+	
+	// blocking helpers used by the synchronous commands
+	Status execute(const CommandFrame& command, QByteArray& ack);
+	void waitFor(const bool& finished);
+	
+	// packet engine
+	void enqueue(Request&& request);
+	void startNext();
+	void finish(Status status, const QByteArray& reply);
+	void handlePacket(PacketType type, const QByteArray& data);
+	void onReadyRead();
+	void onBytesWritten();
+	void onTimeout();
 	
 	QSerialPort* serial;
 	
+	RingQueue<Request> requests;	// pending requests, head is the active one
+	EngineState state;
+	PacketFramer framer;		// serial receive buffer and packet parser
+	QByteArray rxPacket;		// content of the last received packet, reused
+	QByteArray rxData;			// data collected during RECEIVE
+	QTimer timeoutTimer;		// request timeout (asynchronous use)
+	QElapsedTimer requestTime;	// request timeout (blocking use)
+	int requestTimeout;			// (milliseconds)
+	QElapsedTimer settleTime;	// end of the last download
+	int settleDelay;			// (milliseconds) quiet time after the last download before the next command
+	
+	int baud;					// current baud rate
+	int linkErrors;				// number of consecutive packet errors/timeouts
+	int packetSize;				// size of DATA packets in bytes
+	
 	// configuration
 	int SERIAL_TIMEOUT;		// (seconds) timeout for serial port communication
 	uint16_t MAX_FINGERS;	// capacitiy of fingerprint library
+	int MAX_BAUD;			// highest baud rate used for the serial link
+	int MAX_PACKET_SIZE;	// largest DATA packet size used for transfers (32, 64, 128 or 256 bytes)
 
 };
 
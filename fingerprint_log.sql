@@ -0,0 +1,26 @@
+-- change log of the fingerprint table, used by fp-server for incremental sync
+-- install with: mysql minutiae < fingerprint_log.sql
+
+CREATE TABLE IF NOT EXISTS fingerprint_log (
+	seq BIGINT UNSIGNED NOT NULL AUTO_INCREMENT PRIMARY KEY,
+	id INT NOT NULL,
+	changed TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+	KEY (changed)
+);
+
+DROP TRIGGER IF EXISTS fingerprint_log_insert;
+DROP TRIGGER IF EXISTS fingerprint_log_update;
+DROP TRIGGER IF EXISTS fingerprint_log_delete;
+
+CREATE TRIGGER fingerprint_log_insert AFTER INSERT ON fingerprint
+	FOR EACH ROW INSERT INTO fingerprint_log (id) VALUES (NEW.id);
+
+-- a changed id is logged as old and new id
+CREATE TRIGGER fingerprint_log_update AFTER UPDATE ON fingerprint
+	FOR EACH ROW INSERT INTO fingerprint_log (id) VALUES (OLD.id), (NEW.id);
+
+CREATE TRIGGER fingerprint_log_delete AFTER DELETE ON fingerprint
+	FOR EACH ROW INSERT INTO fingerprint_log (id) VALUES (OLD.id);
+
+-- fp-server needs read and delete access to the log
+-- GRANT SELECT, DELETE ON minutiae.fingerprint_log TO 'fp-server'@'localhost';
@@ -9,13 +9,50 @@ CONFIG -= app_bundle
 
 TEMPLATE = app
 
+DISTFILES += fingerprint_log.sql
+
 SOURCES += main.cpp \
     fingerprint.cpp \
+    packetframer.cpp \
+    slotbitmap.cpp \
+    sensorlibrary.cpp \
+    templateloader.cpp \
+    reconciler.cpp \
+    templatecache.cpp \
+    snapshot.cpp \
+    hotband.cpp \
+    taskscheduler.cpp \
+    scangovernor.cpp \
+    changelog.cpp \
+    dbworker.cpp \
+    gpio.cpp \
+    gpiochardev.cpp \
+    gpiofake.cpp \
+    dooractuator.cpp \
     fpthread.cpp \
     fpmain.cpp
 
 HEADERS += \
     fingerprint.h \
+    packetframer.h \
+    commandframe.h \
+    slotbitmap.h \
+    sensorlibrary.h \
+    templateloader.h \
+    reconciler.h \
+    templatecache.h \
+    snapshot.h \
+    hotband.h \
+    taskscheduler.h \
+    scangovernor.h \
+    spscqueue.h \
+    ringqueue.h \
+    changelog.h \
+    dbworker.h \
+    gpio.h \
+    gpiochardev.h \
+    gpiofake.h \
+    dooractuator.h \
     fpthread.h \
     defs.h \
     fpmain.h
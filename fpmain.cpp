@@ -4,21 +4,29 @@
 
 #include <QDebug>
 #include <QJsonDocument>
-#include <stdlib.h>
 
 FpMain::FpMain(QObject *parent) : QObject(parent)
 {
-	// read config
+	// configure GPIO
 	QSettings conf(CONFIG_FILE, QSettings::IniFormat, this);
-	SINGLE_OPEN_TIME = conf.value("SINGLE_OPEN_TIME", 5).toUInt();
-	BUZZ_OPEN_PWM = conf.value("BUZZ_OPEN_PWM", 256).toUInt();
-	BUZZ_PULSE_TIME = conf.value("BUZZ_PULSE_TIME", 100).toUInt();
+	gpio.reset(Gpio::create(conf));
+	if(!gpio->setup())
+	{
+		qCritical() << "GPIO setup failed";
+	}
+	door = new DoorActuator(gpio.data(), this);
+	connect(door, SIGNAL(stateChanged(DoorActuator::State)), this, SLOT(doorStateChanged(DoorActuator::State)));
 	
 	// start fingerprint thread
 	connect(this, SIGNAL(enroll(bool)), &fpThread, SLOT(enroll(bool)));
 	connect(this, SIGNAL(del(int)), &fpThread, SLOT(del(int)));
+	connect(this, SIGNAL(libraryChanged()), &fpThread, SLOT(syncNow()));
+	connect(this, SIGNAL(verify(int,bool)), &fpThread, SLOT(verify(int,bool)));
+	connect(this, SIGNAL(search()), &fpThread, SLOT(search()));
 	connect(&fpThread, SIGNAL(match(int,int,bool)), this, SLOT(fpMatch(int,int,bool)));
 	connect(&fpThread, SIGNAL(enrollFinished(int, bool)), this, SLOT(fpEnrollFinished(int, bool)));
+	connect(&fpThread, SIGNAL(verifyFinished(int,bool,int,bool)), this, SLOT(fpVerifyFinished(int,bool,int,bool)));
+	fpThread.setGpio(gpio.data());
 	fpThread.start();
 	
 	// start MQTT connection
@@ -27,14 +35,6 @@ FpMain::FpMain(QObject *parent) : QObject(parent)
 	mClient.setHostname("localhost");
 	mClient.setPort(1883);
 	mClient.connectToHost();
-
-	// configure GPIO
-	system("gpio mode 1 pwm");		// door buzzer
-	system("gpio mode 4 out");		// green LED
-	system("gpio mode 5 out");		// red LED
-	system("gpio mode 7 in");		// sensor button
-
-	lock();
 }
 
 
@@ -54,6 +54,9 @@ void FpMain::mqttStateChanged()
 			mClient.subscribe(QMqttTopicFilter("DELETE"), 1);
 			mClient.subscribe(QMqttTopicFilter("UNLOCK"), 1);
 			mClient.subscribe(QMqttTopicFilter("LOCK"), 1);
+			mClient.subscribe(QMqttTopicFilter("LIBRARY_CHANGED"), 1);
+			mClient.subscribe(QMqttTopicFilter("VERIFY"), 1);
+			mClient.subscribe(QMqttTopicFilter("SEARCH"), 1);
 			
 			break;
 		}
@@ -98,6 +101,25 @@ void FpMain::fpEnrollFinished(int id, bool success)
 }
 
 
+void FpMain::fpVerifyFinished(int id, bool success, int score, bool button)
+{
+	QJsonObject obj(
+	{
+		{"pattern", "VERIFY_FINISHED"},
+		{"data", QJsonObject(
+		{
+			{"externalFingerId", id},
+			{"success", success},
+			{"score", score},
+			{"button", button}
+		})
+		}
+	});
+	QJsonDocument doc(obj);
+	mClient.publish(QMqttTopicName("VERIFY_FINISHED"), doc.toJson(), 1);
+}
+
+
 void FpMain::mqttReceive(const QByteArray &message, const QMqttTopicName &topic)
 {
 	//qDebug() << "MQTT message received";
@@ -154,42 +176,47 @@ void FpMain::mqttReceive(const QByteArray &message, const QMqttTopicName &topic)
 		{
 			keepOpen = obj["keepOpen"].toBool();
 		}
-		unlock(keepOpen);
+		door->unlock(keepOpen);
 	}
 	else if(topic.name() == "LOCK")
 	{
-		lock();
+		door->lock();
 	}
-	else
+	else if(topic.name() == "LIBRARY_CHANGED")
 	{
-		qWarning() << "mqttReceive(): unknown topic" << topic.name();
+		emit libraryChanged();
 	}
-}
-
-
-void FpMain::unlock(bool keepOpen)
-{
-	qDebug() << "UNLOCK, keepOpen:" << keepOpen;
-	system("gpio pwm 1 1024");		// door buzzer full power
-	system("gpio write 4 1");		// green LED on
-	system("gpio write 5 0");		// red LED off
-	QThread::msleep(BUZZ_PULSE_TIME);
-
-	system(QString("gpio pwm 1 %1").arg(BUZZ_OPEN_PWM).toStdString().c_str());		// reduce buzzer pwm to minimize power dissipation
-	
-	if(!keepOpen)
+	else if(topic.name() == "VERIFY")
 	{
-		QTimer::singleShot(int32_t(SINGLE_OPEN_TIME) * 1000, this, SLOT(lock()));
+		if(obj.contains("externalFingerId"))
+		{
+			int id = obj["externalFingerId"].toInt();
+			bool repeat = false;
+			if(obj.contains("repeat"))
+			{
+				repeat = obj["repeat"].toBool();
+			}
+			emit verify(id, repeat);
+		}
+		else
+		{
+			qWarning() << "mqttReceive(): VERIFY: 'externalFingerId' not found";
+		}
+	}
+	else if(topic.name() == "SEARCH")
+	{
+		emit search();
+	}
+	else
+	{
+		qWarning() << "mqttReceive(): unknown topic" << topic.name();
 	}
 }
 
 
-void FpMain::lock()
+void FpMain::doorStateChanged(DoorActuator::State state)
 {
-	qDebug() << "LOCK";
-	system("gpio pwm 1 0");			// buzzer off
-	system("gpio write 4 0");		// green LED off
-	system("gpio write 5 1");		// red LED on
+	qDebug() << "door:" << DoorActuator::stateName(state);
 }
 
 
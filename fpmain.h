@@ -3,10 +3,13 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QScopedPointer>
 #include <QtMqtt/QtMqtt>
 #include <QTimer>
 
 #include "fpthread.h"
+#include "gpio.h"
+#include "dooractuator.h"
 
 class FpMain : public QObject
 {
@@ -18,24 +21,23 @@ public:
 signals:
 	void enroll(bool run);
 	void del(int id);
+	void libraryChanged();
+	void verify(int id, bool repeat);
+	void search();
 	
 private slots:
 	void mqttStateChanged();
 	void fpMatch(int id, int score, bool button);
 	void fpEnrollFinished(int id, bool success);
+	void fpVerifyFinished(int id, bool success, int score, bool button);
 	void mqttReceive(const QByteArray &message, const QMqttTopicName &topic);
-	void unlock(bool keepOpen);
-	void lock();
+	void doorStateChanged(DoorActuator::State state);
 	
 private:
+	QScopedPointer<Gpio> gpio;		// declared before fpThread, which uses it
 	FpThread fpThread;
 	QMqttClient mClient;
-	QTimer lockTimer;
-
-	// configuration
-	uint32_t SINGLE_OPEN_TIME;		// (seconds) unlock time for single access
-	uint32_t BUZZ_OPEN_PWM;			// PWM duty cycle (1024=max) used for keeping door buzzer open
-	uint32_t BUZZ_PULSE_TIME;		// (milliseconds) initial pulse time to open door buzzer
+	DoorActuator* door;
 	
 };
 
@@ -1,32 +1,103 @@
 #include "fpthread.h"
 #include "fingerprint.h"
+#include "templateloader.h"
+#include "reconciler.h"
+#include "gpio.h"
+#include "dbworker.h"
 #include "defs.h"
 #include <QDebug>
 #include <QThread>
 #include <QSettings>
-#include <QProcess>
-#include <QtSql>
 #include <QDateTime>
 #include <QTime>
-
-
-FpThread::FpThread(QObject *parent) : QThread(parent)
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTimer>
+
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+
+#define STAMP_PAGE 0			// notepad page of the library stamp
+#define STAMP_MAGIC "FPS"
+#define STAMP_VERSION 2
+
+#define RELOCATE_INTERVAL 10	// (seconds) minimum time between two template moves into the hot band
+#define COMPACT_INTERVAL 1		// (seconds) minimum time between two template moves of the compaction
+#define DELETE_RETRY 10			// (seconds) time before the IDs of a failed DELETE are deleted again
+#define RECONNECT_INTERVAL 10	// (seconds) interval of connection attempts while the database is not available
+#define FILL_INTERVAL 1			// (seconds) interval for copying templates from the database to the snapshot
+#define FULL_SYNC_INTERVAL 5	// (seconds) interval for comparing all IDs with the database, used without change log
+#define TOUCH_SCAN_TIME 2000	// (milliseconds) continuous scanning after a touch event
+#define STATS_INTERVAL 600		// (seconds) interval for logging the scan rate and CPU load of the sensor thread
+#define FILL_BATCH 16			// number of templates copied to the snapshot at a time
+#define FILL_CHECK 256			// number of IDs checked for a snapshot record at a time
+#define FETCH_BATCH 64			// number of templates copied to the snapshot at a time for a reconcile
+#define RECONCILE_BATCH 4		// number of templates stored on the sensor in one slice, the reconcile continues in the next
+#define FLUSH_DELAY 10			// (milliseconds) retry interval for commands and events that did not fit into the queue
+
+
+FpThread::FpThread(QObject *parent) : QThread(parent), changeLog(&dbWorker)
 {
 	mode = NORMAL;
+	verifyID = -1;
+	verifyRepeat = false;
+	presence = ARMED;
+	presenceButton = false;
+	gpio = nullptr;
+	syncTask = -1;
+	touchWakeup = false;
+	scans = 0;
+	cpuTime = 0;
+	
+	// written by the main thread and the database worker
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	flushScheduled = false;
+	updatePending = false;
+	deletePending = false;
+	online = false;
+	firstSync = true;
+	syncConnection = 0;
+	syncIncomplete = false;
+	snapshotPending = false;
+	snapshotCursor = 0;
+	verifyFetch = -1;
+	verifyFetchPending = false;
 	
 	QSettings conf(CONFIG_FILE, QSettings::IniFormat, this);
 	MAX_FINGERS = uint16_t(conf.value("MAX_FINGERS", 1000).toInt());
+	TIERED_CACHE = conf.value("TIERED_CACHE", false).toBool();
+	MAX_TEMPLATES = TIERED_CACHE ? conf.value("MAX_TEMPLATES", 10000).toInt() : MAX_FINGERS;
+	CACHE_PAGE_LIMIT = conf.value("CACHE_PAGE_LIMIT", 32).toInt();
+	CACHE_PAGE_TIME = conf.value("CACHE_PAGE_TIME", 2000).toInt();
+	HOT_BAND_SIZE = conf.value("HOT_BAND_SIZE", 16).toInt();
 	ENROLL_TIMEOUT = conf.value("ENROLL_TIMEOUT", 600).toUInt();
-	DATABASE_NAME = conf.value("DATABASE_NAME", "minutiae").toString();
-	DATABASE_USER = conf.value("DATABASE_USER", "fp-server").toString();
-	DATABASE_PASSWD = conf.value("DATABASE_PASSWD", "DY50").toString();
+	VERIFY_TIMEOUT = conf.value("VERIFY_TIMEOUT", 30).toUInt();
+	RETRIGGER_INTERVAL = conf.value("RETRIGGER_INTERVAL", 0).toInt();
+	RETRIGGER_BUTTON = conf.value("RETRIGGER_BUTTON", true).toBool();
+	BENCHMARK_LINK = conf.value("BENCHMARK_LINK", false).toBool();
+	SYNC_INTERVAL = conf.value("SYNC_INTERVAL", 1).toUInt();
+	BACKGROUND_BUDGET = conf.value("BACKGROUND_BUDGET", 50).toInt();
+	TOUCH_WAKEUP = conf.value("TOUCH_WAKEUP", false).toBool();
+	IDLE_HEARTBEAT = conf.value("IDLE_HEARTBEAT", 1000).toInt();
+	SCAN_INTERVAL_MIN = conf.value("SCAN_INTERVAL_MIN", 0).toInt();
+	SCAN_INTERVAL_MAX = conf.value("SCAN_INTERVAL_MAX", 0).toInt();
+	IDLE_BACKOFF = conf.value("IDLE_BACKOFF", 60).toInt();
+	FULL_RATE_WINDOWS = conf.value("FULL_RATE_WINDOWS").toStringList().join(",");		// unquoted lists are split by QSettings
+	
+	governor.reset(new ScanGovernor(SCAN_INTERVAL_MIN, SCAN_INTERVAL_MAX, IDLE_BACKOFF*1000, FULL_RATE_WINDOWS));
 }
 
 
 void FpThread::run()
 {
-	Fingerprint* fp = new Fingerprint();
-	fingerIds = new QSet<int>();
+	// created and deleted in the sensor thread, which the serial port belongs to
+	QScopedPointer<Fingerprint> sensor(new Fingerprint());
+	Fingerprint* fp = sensor.data();
+	stampValid = false;
 	
 	if(!fp->start())
 	{
@@ -34,28 +105,21 @@ void FpThread::run()
 		return;
 	}
 	
-	QThread::sleep(1);		// give FP sensor some time to start
-	
-	Fingerprint::Status status;
-	
-
-	// connect to database
-	QSqlDatabase db = QSqlDatabase::addDatabase("QMYSQL");
-	db.setHostName("127.0.0.1");
-	db.setDatabaseName(DATABASE_NAME);
-	db.setUserName(DATABASE_USER);
-	db.setPassword(DATABASE_PASSWD);
-	bool ok = db.open();
-	if(ok)
+	if(fp->negotiateBaudRate())
 	{
-		qDebug() << "connected to database";
+		fp->negotiatePacketSize();
 	}
 	else
 	{
-		qCritical() << "could not connect to database:" << db.lastError().text();
-		return;
+		qCritical() << "FpThread: no connection to fingerprint sensor";
 	}
-
+	
+	if(BENCHMARK_LINK)
+	{
+		benchmarkLink(fp);
+	}
+	
+	Fingerprint::Status status;
 	
 	/*
 	status = fp->setSysPara(Fingerprint::SECURITY_LEVEL, 3);
@@ -104,62 +168,96 @@ void FpThread::run()
 		qDebug() << "";
 
 	} while(status != Fingerprint::OK);
+	
+	// the capacity reported by the sensor is used
+	if(librarySize > 0 && librarySize != MAX_FINGERS)
+	{
+		qWarning() << "sensor library holds" << librarySize << "templates, MAX_FINGERS =" << MAX_FINGERS << "ignored";
+		MAX_FINGERS = librarySize;
+		if(!TIERED_CACHE)
+		{
+			MAX_TEMPLATES = MAX_FINGERS;
+		}
+	}
+	library.resize(MAX_FINGERS);
+	databaseIds.resize(MAX_TEMPLATES);
+	pendingDeletes.resize(MAX_TEMPLATES);
 
 
-	qDebug() << "clear sensor library";
-	status = fp->emptyDatabase();
-	if(status!=Fingerprint::OK)
+	// content of the sensor library, as recorded when it was last changed
+	library.load();
+	
+	QByteArray notepad;
+	status = fp->readNotepad(STAMP_PAGE, notepad);
+	if(status==Fingerprint::OK)
+	{
+		QByteArray stamp = libraryStamp();
+		stampValid = (notepad.left(stamp.size()) == stamp);
+	}
+	else
 	{
 		fp->printError(status);
 	}
 	
-	qDebug() << "read fingerprint templates from database...";
-	QSqlQuery query;
-	if(query.exec("SELECT * FROM fingerprint"))
+	if(TIERED_CACHE)
 	{
-		while(query.next())
-		{
-			int id = query.value(0).toInt();
-			QByteArray fpTemplate = query.value(1).toByteArray();
-			qDebug() << "\tID:" << id;
-
-			if(id < 0 || id >= MAX_FINGERS)
-			{
-				qCritical() << "invalid id in database, ignored";
-				continue;
-			}
-
-			status = fp->downChar(Fingerprint::SLOT_1, fpTemplate);
-			if(status!=Fingerprint::OK)
-			{
-				// report error
-				fp->printError(status);
-				continue;
-			}
-
-			status = fp->storeModel(Fingerprint::SLOT_1, uint16_t(id));
-			if(status!=Fingerprint::OK)
-			{
-				// report error
-				fp->printError(status);
-				continue;
-			}
-
-			fingerIds->insert(id);
-			//qDebug() << "\ttemplate stored";
-		}
+		qDebug() << "tiered mode, the sensor library caches up to" << MAX_FINGERS << "of" << MAX_TEMPLATES << "templates";
+		cache.reset(new TemplateCache(fp, &library, &snapshot));
 	}
-	else
+	
+	hotBand.reset(new HotBand(fp, &library, qMin(HOT_BAND_SIZE, int(MAX_FINGERS))));
+	
+	// local copy of the database
+	snapshot.open(MAX_TEMPLATES);
+	
+	// all queries are executed by the database worker, the sensor thread has no connection of its own
+	dbWorker.setNotify([this]()
+	{
+		wake();
+	});
+	dbWorker.start();
+	addTasks(fp);
+	
+	// finger scans are started by touch events, with a slow heartbeat in case an event is missed
+	touchWakeup = TOUCH_WAKEUP && gpio && gpio->touchFd() >= 0;
+	if(touchWakeup)
+	{
+		qDebug() << "finger detection by touch events, heartbeat" << IDLE_HEARTBEAT << "ms";
+	}
+	else if(TOUCH_WAKEUP)
 	{
-		qCritical() << "SQL query failed:" << query.lastError().text();
+		qWarning() << "TOUCH_WAKEUP: no touch input available, scanning continuously";
 	}
+	
+	// the recorded library content is used until the database has answered
+	databaseIds = validIds(knownHashes());
+	synchronize(fp);
 	qDebug() << "finished!";
 
 
+	Mode lastMode = mode;
 	while(true)
 	{
 		//QThread::msleep(100);
 		
+		if(fp->linkDegraded())
+		{
+			fp->fallBack();
+		}
+		
+		if(!eventOverflow.isEmpty())
+		{
+			flushEvents();
+		}
+		processCommands(fp);
+		
+		// after ENROLL and VERIFY the finger is usually still on the sensor, it has to be lifted first
+		if(mode != lastMode && mode == NORMAL)
+		{
+			identified();
+		}
+		lastMode = mode;
+		
 		switch(mode)
 		{
 			case NORMAL:
@@ -174,9 +272,9 @@ void FpThread::run()
 				break;
 			}
 				
-			case DELETE:
+			case VERIFY:
 			{
-				deleteMode(fp);
+				verifyMode(fp);
 				break;
 			}
 		}
@@ -184,184 +282,226 @@ void FpThread::run()
 }
 
 
-void FpThread::normalMode(Fingerprint* fp)
+/*
+ * (main thread) pass <command> to the sensor thread
+ */
+void FpThread::queue(const Command& command)
 {
-	Fingerprint::Status status;
+	if(overflow.isEmpty() && commands.push(command))
+	{
+		wake();
+		return;
+	}
 	
-	// try to generate image of finger
-	status=fp->genImage();
+	// keep the order, the command waits behind the ones that did not fit
+	overflow.enqueue(command);
+	flushCommands();
+}
+
+
+/*
+ * move the commands that did not fit into the full queue, retried until the sensor thread took all of them
+ * (main thread)
+ */
+void FpThread::flushCommands()
+{
+	bool pushed = false;
+	while(!overflow.isEmpty() && commands.push(overflow.head()))
+	{
+		overflow.dequeue();
+		pushed = true;
+	}
+	if(pushed)
+	{
+		wake();
+	}
 	
-	// skip the trivial case NO_FINGER
-	if(status!=Fingerprint::NOFINGER)
+	if(!overflow.isEmpty() && !flushScheduled)
 	{
-		// check for errors
-		if(status!=Fingerprint::OK)
-		{
-			// report error and try again next time
-			fp->printError(status);
-			return;
-		}
-		
-		qDebug() << "finger detected, checking for match...";
-		
-		// try to create feature file from image
-		status=fp->image2Tz(Fingerprint::SLOT_1);
-		if(status!=Fingerprint::OK)
-		{
-			// report error and try again next time
-			fp->printError(status);
-			return;
-		}
-		
-		uint16_t id=0;
-		uint16_t score=0;
-		status=fp->search(Fingerprint::SLOT_1, 0, MAX_FINGERS, id, score);
-		if(status==Fingerprint::OK)
-		{
-			// found a match
-			
-			// check for button
-			QProcess process;
-			process.start("gpio read 7");
-			process.waitForFinished(1000);
-			int butRead = QString::fromUtf8(process.readAllStandardOutput()).toInt();
-
-			bool button = (butRead == 0);		// invert button signal
-			
-			qDebug() << "MATCH, id:" << id << "score:" << score << "button:" << button;
-			emit match(id, score, button);
-			//QThread::msleep(500);
-		}
-		else if(status==Fingerprint::NOTFOUND)
+		qWarning() << "FpThread: command queue full," << overflow.size() << "commands waiting";
+		flushScheduled = true;
+		QTimer::singleShot(FLUSH_DELAY, this, [this]()
 		{
-			qDebug() << "no match";
-			return;
-		}
-		else
-		{
-			fp->printError(status);
-			return;
-		}
+			flushScheduled = false;
+			flushCommands();
+		});
 	}
-	else
-	{
-		// update routine
-		// this is done on a regular basis to check updates of the database
+}
 
-		static QDateTime lastTime = QDateTime::currentDateTime();
-		if(QDateTime::currentDateTime() > lastTime.addSecs(5))		// check every 5s
-		{
-			lastTime = QDateTime::currentDateTime();
 
-			//qDebug() << "check database for update";
+/*
+ * interrupt the wait for a finger
+ */
+void FpThread::wake()
+{
+	uint64_t one = 1;
+	if(::write(wakeFd, &one, sizeof(one)) != sizeof(one))
+	{
+		qWarning() << "FpThread: could not wake the sensor thread";
+	}
+}
+
 
-			QSqlQuery query;
-			if(!query.exec("SELECT id FROM fingerprint"))
+/*
+ * execute the commands queued by the main thread, queued DELETEs are executed together
+ */
+void FpThread::processCommands(Fingerprint* fp)
+{
+	Command command = {};
+	while(commands.pop(command))
+	{
+		governor->activity();
+		
+		switch(command.type)
+		{
+			case Command::ENROLL:
 			{
-				qCritical() << "update: failed to read IDs from database:" << query.lastError().text();
-				return;
+				qDebug() << "ENROLL new finger...";
+				enrollStartTime = QDateTime::currentDateTime();
+				mode = ENROLL;
+				break;
 			}
-			QSet<int> dbIds;
-			while(query.next())
+				
+			case Command::ABORT_ENROLL:
 			{
-				dbIds.insert(query.value(0).toInt());
+				qDebug() << "ENROLL aborted";
+				mode = NORMAL;
+				post(Event::ENROLL_FINISHED, -1, 0, false, false);
+				break;
 			}
-
-			// compare sets of finger IDs
-
-			// this is the set of fingers that are in the db but not on the sensor -> load to sensor
-			auto newIds = dbIds - *fingerIds;
-
-			// this is the set of fingers that are on the sensor but not in the db -> delete them from sensor
-			auto oldIds = *fingerIds - dbIds;
-
-			// load one new template
-			if(!newIds.isEmpty())
+				
+			case Command::DELETE:
 			{
-				int newId = newIds.toList().first();
-				if(newId < 0 || newId >= MAX_FINGERS)
-				{
-					qCritical() << "update: invalid ID in database:" << newId;
-					return;
-				}
-
-				query.prepare("SELECT template FROM fingerprint WHERE id=:id");
-				query.bindValue(":id", newId);
-				if(!query.exec())
+				if(!pendingDeletes.insert(command.id))
 				{
-					qCritical() << "update: could not read template from database:" << query.lastError().text();
-					return;
+					qWarning() << "DELETE: invalid id:" << command.id;
 				}
-				if(!query.next())
+				break;
+			}
+				
+			case Command::SYNC:
+			{
+				scheduler.trigger(syncTask);
+				break;
+			}
+				
+			case Command::VERIFY:
+			{
+				qDebug() << "VERIFY id" << command.id << (command.repeat ? "until SEARCH" : "");
+				verifyID = command.id;
+				verifyRepeat = command.repeat;
+				verifyStartTime = QDateTime::currentDateTime();
+				verifyFetch = -1;
+				presence = ARMED;
+				mode = VERIFY;
+				break;
+			}
+				
+			case Command::SEARCH:
+			{
+				if(mode == VERIFY)
 				{
-					return;
+					qDebug() << "SEARCH mode";
+					mode = NORMAL;
 				}
-				QByteArray fpTemplate = query.value(0).toByteArray();
+				break;
+			}
+		}
+	}
+	
+	if(!pendingDeletes.isEmpty())
+	{
+		deleteTemplates(fp);
+	}
+}
 
-				status = fp->downChar(Fingerprint::SLOT_1, fpTemplate);
-				if(status!=Fingerprint::OK)
-				{
-					fp->printError(status);
-					return;
-				}
 
-				status = fp->storeModel(Fingerprint::SLOT_1, uint16_t(newId));
-				if(status!=Fingerprint::OK)
-				{
-					fp->printError(status);
-					return;
-				}
+/*
+ * pass an event to the main thread
+ */
+void FpThread::post(Event::Type type, int id, int score, bool success, bool button)
+{
+	Event event;
+	event.type = type;
+	event.id = id;
+	event.score = score;
+	event.success = success;
+	event.button = button;
+	
+	if(eventOverflow.isEmpty() && events.push(event))
+	{
+		scheduleDelivery();
+		return;
+	}
+	
+	// keep the order, the event waits behind the ones that did not fit
+	if(eventOverflow.isEmpty())
+	{
+		qWarning() << "FpThread: event queue full, events are delivered later";
+	}
+	eventOverflow.enqueue(event);
+	flushEvents();
+}
 
-				fingerIds->insert(newId);
 
-				qDebug() << "new template ID:" << newId << "loaded";
-				return;
-			}
+/*
+ * move the events that did not fit into the full queue, retried by the sensor loop until the main thread took all of them
+ */
+void FpThread::flushEvents()
+{
+	bool pushed = false;
+	while(!eventOverflow.isEmpty() && events.push(eventOverflow.head()))
+	{
+		eventOverflow.dequeue();
+		pushed = true;
+	}
+	if(pushed)
+	{
+		scheduleDelivery();
+	}
+}
 
-			// delete one old template
-			if(!oldIds.isEmpty())
-			{
-				int oldId = oldIds.toList().first();
-				if(oldId < 0 || oldId >= MAX_FINGERS)
-				{
-					qCritical() << "update: invalid ID:" << oldId;
-					return;
-				}
 
-				// try to delete template on sensor
-				status=fp->deleteModel(uint16_t(oldId), 1);
-				if(status!=Fingerprint::OK)
-				{
-					fp->printError(status);
-					return;
-				}
+/*
+ * deliverEvents() is only scheduled if the queue was drained
+ */
+void FpThread::scheduleDelivery()
+{
+	if(eventsPending.testAndSetOrdered(0, 1))
+	{
+		QMetaObject::invokeMethod(this, "deliverEvents", Qt::QueuedConnection);
+	}
+}
 
-				fingerIds->remove(oldId);
 
-				qDebug() << "removed old template ID:" << oldId;
-				return;
-			}
+/*
+ * (main thread) emit the events posted by the sensor thread
+ */
+void FpThread::deliverEvents()
+{
+	// events posted from now on schedule another call
+	eventsPending.storeRelease(0);
+	
+	Event event;
+	while(events.pop(event))
+	{
+		switch(event.type)
+		{
+			case Event::MATCH: emit match(event.id, event.score, event.button); break;
+			case Event::ENROLL_FINISHED: emit enrollFinished(event.id, event.success); break;
+			case Event::VERIFY_FINISHED: emit verifyFinished(event.id, event.success, event.score, event.button); break;
 		}
 	}
 }
 
 
-void FpThread::enrollMode(Fingerprint* fp)
+void FpThread::normalMode(Fingerprint* fp)
 {
-	static Fingerprint::Slot slot = Fingerprint::SLOT_1;
-	
 	Fingerprint::Status status;
-
-	if(QDateTime::currentDateTime() > enrollStartTime.addSecs(ENROLL_TIMEOUT))
-	{
-		qWarning() << "ENROLL timed out";
-		emit enrollFinished(-1, false);
-		mode = NORMAL;
-		return;
-	}
 	
 	// try to generate image of finger
 	status=fp->genImage();
+	scans++;
 	
 	// skip the trivial case NO_FINGER
 	if(status!=Fingerprint::NOFINGER)
@@ -374,10 +514,18 @@ void FpThread::enrollMode(Fingerprint* fp)
 			return;
 		}
 		
-		qDebug() << "finger detected, creating feature file in slot" << slot;
+		governor->detected();
+		
+		// a finger that was identified is not searched again until it is lifted
+		if(!identifyAgain())
+		{
+			return;
+		}
+		
+		qDebug() << "finger detected, checking for match...";
 		
 		// try to create feature file from image
-		status=fp->image2Tz(slot);
+		status=fp->image2Tz(Fingerprint::SLOT_1);
 		if(status!=Fingerprint::OK)
 		{
 			// report error and try again next time
@@ -385,56 +533,857 @@ void FpThread::enrollMode(Fingerprint* fp)
 			return;
 		}
 		
-		if(slot == Fingerprint::SLOT_1)
-		{
-			qDebug() << "slot 1 successfull, continue with slot 2...";
-			slot = Fingerprint::SLOT_2;
-			return;
-		}
-
-		if(slot == Fingerprint::SLOT_2)
+		// search the occupied part of the library only, hot band first
+		uint16_t slot=0;
+		uint16_t score=0;
+		status = hotBand->search(slot, score);
+		if(status==Fingerprint::OK)
 		{
-			qDebug() << "slot 2 successfull, generate template...";
-
-			slot = Fingerprint::SLOT_1;
-			
-			status = fp->createModel();
-			if(status!=Fingerprint::OK)
+			// found a match
+			int id = library.idAt(slot);
+			if(id < 0)
 			{
-				// report error and try again next time
-				fp->printError(status);
+				// left over from an interrupted transfer, the finger is searched again without it
+				qWarning() << "unknown template in slot" << slot << "deleted";
+				if(invalidateStamp(fp))
+				{
+					fp->deleteModel(slot, 1);
+				}
 				return;
 			}
-
-			qDebug() << "template successfull, find free ID in database...";
-
-			// find free ID
-			QSqlQuery query;
-			if(!query.exec("SELECT id FROM fingerprint ORDER BY id ASC"))
+			
+			// one identification per placement, unmatched fingers as well (after errors the finger is scanned again)
+			identified();
+			
+			if(!databaseIds.contains(id))
 			{
-				qCritical() << "ENROLL: failed to find free ID in database:" << query.lastError().text();
+				// deleted in the database, the sensor library could not be changed yet
+				qWarning() << "deleted template in slot" << slot << "matched, ignored";
 				return;
 			}
-			uint16_t enrollID = 0;
-			while(query.next())
+			
+			if(cache)
 			{
-				if(query.value(0) != enrollID)
-				{
-					break;
-				}
-				enrollID++;
+				cache->hit(id);
 			}
-
-			if(enrollID >= MAX_FINGERS)
+			hotBand->matched(id);
+			reportMatch(id, score);
+		}
+		else if(status==Fingerprint::NOTFOUND)
+		{
+			int id;
+			if(cache)
+			{
+				status = pageIn(fp, id, score);
+				if(status==Fingerprint::OK)
+				{
+					identified();
+					hotBand->matched(id);
+					return;
+				}
+				if(status!=Fingerprint::NOTFOUND)
+				{
+					// paging failed, the finger is scanned again
+					return;
+				}
+			}
+			
+			identified();
+			qDebug() << "no match";
+			return;
+		}
+		else
+		{
+			fp->printError(status);
+			return;
+		}
+	}
+	else
+	{
+		fingerLifted();
+		
+		// background work until the next scan
+		scheduler.runSlice(BACKGROUND_BUDGET);
+		waitForFinger();
+	}
+}
+
+
+/*
+ * background work of the sensor thread, run between the finger scans while the character buffers are not in use
+ */
+void FpThread::addTasks(Fingerprint* fp)
+{
+	// results of database requests
+	scheduler.add("database results", 0, [this]()
+	{
+		dbWorker.deliver();
+		return true;
+	});
+	
+	scheduler.add("reconnect", RECONNECT_INTERVAL*1000, [this, fp]()
+	{
+		checkConnection();
+		if(!online && !updatePending)
+		{
+			synchronize(fp);
+		}
+		return true;
+	});
+	
+	syncTask = scheduler.add("sync", SYNC_INTERVAL*1000, [this, fp]()
+	{
+		return update(fp);
+	});
+	
+	scheduler.add("snapshot", FILL_INTERVAL*1000, [this]()
+	{
+		if(online)
+		{
+			fillSnapshot();
+		}
+		return true;
+	});
+	
+	scheduler.add("compaction", COMPACT_INTERVAL*1000, [this, fp]()
+	{
+		compact(fp);
+		return true;
+	});
+	
+	scheduler.add("hot band", RELOCATE_INTERVAL*1000, [this, fp]()
+	{
+		relocate(fp);
+		return true;
+	});
+	
+	statsTime.start();
+	scheduler.add("statistics", STATS_INTERVAL*1000, [this]()
+	{
+		reportStatistics();
+		return true;
+	});
+}
+
+
+/*
+ * pause between two scans without finger, ended early by a command or database result or the next background task
+ * with touch events: sleep until the sensor is touched, at most IDLE_HEARTBEAT in case a touch event was missed
+ * without: the pause is set by the scan governor
+ */
+void FpThread::waitForFinger()
+{
+	int timeout;
+	if(touchWakeup)
+	{
+		// the finger may not be detected by the first scan after the touch
+		if(touchTime.isValid() && touchTime.elapsed() < TOUCH_SCAN_TIME)
+		{
+			return;
+		}
+		touchTime.invalidate();
+		timeout = IDLE_HEARTBEAT;
+	}
+	else
+	{
+		timeout = governor->interval();
+		if(timeout <= 0)
+		{
+			return;
+		}
+	}
+	
+	// negative file descriptors are ignored by poll()
+	struct pollfd fds[2];
+	fds[0].fd = touchWakeup ? gpio->touchFd() : -1;
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+	fds[1].fd = wakeFd;
+	fds[1].events = POLLIN;
+	fds[1].revents = 0;
+	
+	timeout = qMin(timeout, scheduler.idleTime());
+	if(!eventOverflow.isEmpty())
+	{
+		timeout = qMin(timeout, FLUSH_DELAY);
+	}
+	if(!commands.isEmpty())
+	{
+		timeout = 0;
+	}
+	
+	if(poll(fds, 2, timeout) < 0)
+	{
+		return;
+	}
+	
+	if(fds[1].revents & POLLIN)
+	{
+		uint64_t count;
+		if(::read(wakeFd, &count, sizeof(count)) != sizeof(count))
+		{
+			qWarning() << "FpThread: could not read wake event";
+		}
+	}
+	
+	if((fds[0].revents & POLLIN) && gpio->readTouch())
+	{
+		touchTime.start();
+	}
+}
+
+
+/*
+ * finger scans per second and CPU load of the sensor thread since the last report
+ */
+void FpThread::reportStatistics()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	qint64 cpu = qint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+	qint64 elapsed = statsTime.restart();
+	
+	if(elapsed > 0)
+	{
+		qDebug() << "sensor thread:" << QString::number(scans * 1000.0 / elapsed, 'f', 1) << "scans/s, CPU"
+				 << QString::number((cpu - cpuTime) / (elapsed * 10000.0), 'f', 1) << "%"
+				 << (touchWakeup ? "(touch wakeup)" : "(polling)");
+	}
+	
+	scans = 0;
+	cpuTime = cpu;
+}
+
+
+/*
+ * check the database for changes
+ * return value: false if the previous check is not completed yet
+ */
+bool FpThread::update(Fingerprint* fp)
+{
+	checkConnection();
+	if(updatePending)
+	{
+		return false;
+	}
+	
+	// the changes are applied once the full reconcile is completed (offline as well, from the snapshot)
+	if(syncIncomplete)
+	{
+		reconcileAll(fp, QHash<int, QByteArray>(syncHashes), false);
+		return true;
+	}
+	if(!online)
+	{
+		return true;
+	}
+	
+	if(changeLog.isAvailable())
+	{
+		updateFromChangeLog(fp);
+	}
+	else
+	{
+		updateFromDatabase(fp);
+	}
+	return true;
+}
+
+
+/*
+ * full comparison of the sensor library with the database, at startup and when the database is available again
+ * the hashes are read by the database worker, the sensor library is reconciled when they are delivered
+ */
+void FpThread::synchronize(Fingerprint* fp)
+{
+	updatePending = true;
+	
+	// changes from now on are applied incrementally
+	changeLog.start([this](bool available)
+	{
+		scheduler.setPeriod(syncTask, (available ? SYNC_INTERVAL : FULL_SYNC_INTERVAL) * 1000);
+	});
+	
+	readDatabase([this, fp](bool ok, const QHash<int, QByteArray>& dbHashes)
+	{
+		updatePending = false;
+		if(!ok)
+		{
+			// retried by the reconnect task
+			if(firstSync)
+			{
+				firstSync = false;
+				startOffline(fp);
+			}
+			return;
+		}
+		
+		firstSync = false;
+		online = true;
+		syncConnection = dbWorker.connectionCount();
+		databaseIds = validIds(dbHashes);
+		snapshot.retain(dbHashes);
+		
+		if(stampValid)
+		{
+			qDebug() << "sensor library matches the stamp," << library.count() << "templates";
+		}
+		else
+		{
+			qDebug() << "sensor library was changed since the last stamp";
+		}
+		
+		// the index table is only read if the recorded content is not confirmed by the stamp
+		qDebug() << "reconcile sensor library with database...";
+		reconcileAll(fp, dbHashes, !stampValid);
+	});
+}
+
+
+/*
+ * reconcile with all template hashes of the database, continued by the next updates until the sensor library
+ * is in sync (missing templates are copied to the snapshot meanwhile)
+ */
+void FpThread::reconcileAll(Fingerprint* fp, const QHash<int, QByteArray>& dbHashes, bool checkSensor)
+{
+	syncHashes = dbHashes;
+	syncIncomplete = !reconcile(fp, dbHashes, checkSensor);
+	if(syncIncomplete)
+	{
+		return;
+	}
+	
+	syncHashes.clear();
+	if(!stampValid)
+	{
+		writeStamp(fp);
+	}
+}
+
+
+/*
+ * the database is not available: the recorded library content and the snapshot are used,
+ * missing templates are loaded from the snapshot
+ */
+void FpThread::startOffline(Fingerprint* fp)
+{
+	QHash<int, QByteArray> hashes = knownHashes();
+	qWarning() << "starting without database," << snapshot.ids().count() << "templates in the snapshot";
+	databaseIds = validIds(hashes);
+	reconcileAll(fp, hashes, !stampValid);
+}
+
+
+/*
+ * the connection of the database worker was lost (e.g. restart of the database server):
+ * the updates stop until the reconnect task has synchronized again
+ */
+void FpThread::checkConnection()
+{
+	if(online && (!dbWorker.isConnected() || dbWorker.connectionCount() != syncConnection))
+	{
+		qWarning() << "connection to database lost, synchronizing again once it is available";
+		online = false;
+	}
+}
+
+
+/*
+ * template hashes of the snapshot and the sensor library, the templates on the sensor are kept
+ */
+QHash<int, QByteArray> FpThread::knownHashes()
+{
+	QHash<int, QByteArray> hashes = snapshot.hashes();
+	for(int slot : library.occupancy().toList())
+	{
+		hashes.insert(library.idAt(slot), library.md5At(slot));
+	}
+	return hashes;
+}
+
+
+/*
+ * copy templates that are not in the snapshot from the database, a few at a time
+ */
+void FpThread::fillSnapshot()
+{
+	if(snapshotPending)
+	{
+		return;
+	}
+	
+	QList<int> ids;
+	int id = databaseIds.findNext(snapshotCursor);
+	for(int checked = 0; id >= 0 && checked < FILL_CHECK && ids.size() < FILL_BATCH; checked++)
+	{
+		if(!snapshot.contains(id))
+		{
+			ids.append(id);
+		}
+		id = databaseIds.findNext(id+1);
+	}
+	snapshotCursor = qMax(id, 0);
+	
+	fetchTemplates(ids);
+}
+
+
+/*
+ * copy the templates of <ids> from the database to the snapshot, an incomplete reconcile continues once they are stored
+ * return value: false if a previous request is not completed yet
+ */
+bool FpThread::fetchTemplates(const QList<int>& ids)
+{
+	if(snapshotPending)
+	{
+		return false;
+	}
+	if(ids.isEmpty())
+	{
+		return true;
+	}
+	
+	snapshotPending = true;
+	dbWorker.queryIds("SELECT id, template FROM fingerprint WHERE id IN (?)", ids, [this, ids](bool ok, const DbWorker::Rows& rows)
+	{
+		snapshotPending = false;
+		if(ids.contains(verifyFetch))
+		{
+			verifyFetchPending = false;
+		}
+		if(!ok)
+		{
+			if(ids.contains(verifyFetch))
+			{
+				failVerify();
+			}
+			return;
+		}
+		
+		QSet<int> missing;
+		for(int id : ids)
+		{
+			missing.insert(id);
+		}
+		for(const QVariantList& row : rows)
+		{
+			int id = row[0].toInt();
+			snapshot.store(id, row[1].toByteArray());
+			missing.remove(id);
+			
+			// a template changed since the hashes of the incomplete reconcile were read
+			if(syncHashes.contains(id))
+			{
+				syncHashes.insert(id, snapshot.md5(id));
+			}
+		}
+		for(int id : missing)
+		{
+			syncHashes.remove(id);
+		}
+		if(missing.contains(verifyFetch))
+		{
+			failVerify();
+		}
+		
+		if(syncIncomplete)
+		{
+			scheduler.trigger(syncTask);
+		}
+	});
+	return true;
+}
+
+
+/*
+ * end a verification whose claimed template could not be copied from the database
+ * (repeated scans would only request it again)
+ */
+void FpThread::failVerify()
+{
+	if(mode != VERIFY || verifyID != verifyFetch)
+	{
+		return;
+	}
+	
+	qWarning() << "VERIFY: template" << verifyFetch << "could not be read from the database";
+	post(Event::VERIFY_FINISHED, verifyFetch, 0, false, false);
+	mode = NORMAL;
+}
+
+
+/*
+ * highest occupied slot <from> above the lowest free slot <to>
+ * return value: true if the library has holes
+ */
+bool FpThread::findHole(int& from, int& to)
+{
+	from = library.occupancy().upperBound() - 1;
+	to = library.occupancy().findFirstFree();
+	return from >= 0 && to >= 0 && to < from;
+}
+
+
+/*
+ * move the template in the highest occupied slot to the lowest free slot
+ * the search range ends at the highest occupied slot, holes left by deletes are closed one by one
+ */
+void FpThread::compact(Fingerprint* fp)
+{
+	int from, to;
+	if(!findHole(from, to))
+	{
+		return;
+	}
+	
+	if(!invalidateStamp(fp))
+	{
+		return;
+	}
+	if(hotBand->move(from, to))
+	{
+		qDebug() << "compaction: search range" << library.occupancy().upperBound() << "slots," << library.count() << "templates";
+	}
+}
+
+
+/*
+ * move one frequently matched template into the hot band, after the compaction is finished
+ * the templates are moved on the sensor, the stamp is written again by the next update
+ */
+void FpThread::relocate(Fingerprint* fp)
+{
+	int from, to;
+	if(findHole(from, to) || !hotBand->nextMove(from, to))
+	{
+		return;
+	}
+	
+	if(!invalidateStamp(fp))
+	{
+		return;
+	}
+	hotBand->move(from, to);
+}
+
+
+/*
+ * apply the changes listed in the change log of the database
+ */
+void FpThread::updateFromChangeLog(Fingerprint* fp)
+{
+	updatePending = true;
+	changeLog.poll([this, fp](bool ok, const QSet<int>& ids)
+	{
+		if(!ok)
+		{
+			updatePending = false;
+			return;
+		}
+		
+		if(!ids.isEmpty())
+		{
+			qDebug() << "update:" << ids.size() << "IDs changed in database";
+			readChanges(fp, ids);
+			return;
+		}
+		
+		// no pending changes
+		updatePending = false;
+		if(!stampValid)
+		{
+			writeStamp(fp);
+		}
+		
+		changeLog.prune();
+	});
+}
+
+
+/*
+ * read the current state of the changed IDs and apply it
+ */
+void FpThread::readChanges(Fingerprint* fp, const QSet<int>& ids)
+{
+	dbWorker.queryIds("SELECT id, MD5(template) FROM fingerprint WHERE id IN (?)", ids.values(),
+					  [this, fp, ids](bool ok, const DbWorker::Rows& rows)
+	{
+		updatePending = false;
+		if(!ok)
+		{
+			qCritical() << "update: failed to read changed IDs from database";
+			return;
+		}
+		
+		QHash<int, QByteArray> dbHashes;
+		for(const QVariantList& row : rows)
+		{
+			dbHashes.insert(row[0].toInt(), row[1].toByteArray());
+		}
+		
+		// on failure the same changes are returned by the next poll
+		if(applyChanges(fp, ids, dbHashes))
+		{
+			changeLog.acknowledge();
+		}
+	});
+}
+
+
+/*
+ * compare all IDs in the database with the known IDs, used without change log
+ */
+void FpThread::updateFromDatabase(Fingerprint* fp)
+{
+	//qDebug() << "check database for update";
+
+	updatePending = true;
+	dbWorker.query("SELECT id FROM fingerprint", QVariantList(), [this, fp](bool ok, const DbWorker::Rows& rows)
+	{
+		updatePending = false;
+		if(!ok)
+		{
+			qCritical() << "update: failed to read IDs from database";
+			return;
+		}
+		
+		SlotBitmap dbIds(MAX_TEMPLATES);
+		for(const QVariantList& row : rows)
+		{
+			dbIds.insert(row[0].toInt());		// invalid IDs are reported at startup
+		}
+
+		if(dbIds == databaseIds)
+		{
+			// sensor library is in sync with database
+			if(!stampValid)
+			{
+				writeStamp(fp);
+			}
+			return;
+		}
+		
+		// transfer the difference between database and sensor
+		updatePending = true;
+		readDatabase([this, fp](bool ok, const QHash<int, QByteArray>& dbHashes)
+		{
+			updatePending = false;
+			if(!ok)
+			{
+				return;
+			}
+			databaseIds = validIds(dbHashes);
+			snapshot.retain(dbHashes);
+			reconcileAll(fp, dbHashes, false);
+		});
+	});
+}
+
+
+/*
+ * bring the templates of the changed IDs on the sensor in sync with the database
+ * dbHashes: template hashes of the changed IDs that are still in the database
+ * return value: true if all changes were applied
+ */
+bool FpThread::applyChanges(Fingerprint* fp, const QSet<int>& ids, QHash<int, QByteArray> dbHashes)
+{
+	for(int id : ids)
+	{
+		databaseIds.remove(id);
+	}
+	
+	for(int id : dbHashes.keys())
+	{
+		if(!databaseIds.insert(id))
+		{
+			qWarning() << "update: invalid id in database:" << id;
+			dbHashes.remove(id);
+		}
+	}
+	
+	for(int id : ids)
+	{
+		if(snapshot.md5(id) != dbHashes.value(id))
+		{
+			snapshot.remove(id);
+		}
+		
+		if(!dbHashes.contains(id))
+		{
+			hotBand->forget(id);
+			if(cache)
+			{
+				cache->forget(id);
+			}
+		}
+	}
+	
+	// changes made by enroll are already on the sensor and recognised by their template hash
+	Reconciler reconciler(fp, &library, !cache.isNull(), &snapshot);
+	reconciler.compare(dbHashes, ids);
+	return transfer(fp, reconciler);
+}
+
+
+/*
+ * report a match, the sensor button is read at the same time
+ */
+void FpThread::reportMatch(int id, int score)
+{
+	// check for button
+	bool button = (gpio && gpio->read(Gpio::BUTTON) == 0);		// invert button signal
+	
+	qDebug() << "MATCH, id:" << id << "score:" << score << "button:" << button;
+	if(touchTime.isValid())
+	{
+		qDebug() << "touch to match:" << touchTime.elapsed() << "ms";
+		touchTime.invalidate();
+	}
+	post(Event::MATCH, id, score, true, button);
+}
+
+
+/*
+ * cache miss: match the feature file in SLOT_1 with the templates that are not on the sensor
+ * a matching template is reported and stored in the sensor library
+ * additional return parameters:
+ *	* id and score of the match
+ * return value: OK if a template matched, NOTFOUND if none matched, otherwise the error of the sensor
+ */
+Fingerprint::Status FpThread::pageIn(Fingerprint* fp, int& id, uint16_t& score)
+{
+	SlotBitmap candidates = databaseIds;
+	for(int resident : library.ids())
+	{
+		candidates.remove(resident);
+	}
+	
+	QByteArray fpTemplate;
+	Fingerprint::Status result = cache->page(candidates, CACHE_PAGE_LIMIT, CACHE_PAGE_TIME, id, score, fpTemplate);
+	if(result!=Fingerprint::OK)
+	{
+		return result;
+	}
+	
+	// report before the library is changed
+	reportMatch(id, score);
+	
+	// the matching template is still in SLOT_2, it is not stored if the stamp cannot be cleared
+	if(!invalidateStamp(fp))
+	{
+		return Fingerprint::OK;
+	}
+	int slot = cache->allocate();
+	if(slot < 0)
+	{
+		return Fingerprint::OK;
+	}
+	library.save();
+	
+	Fingerprint::Status status = fp->storeModel(Fingerprint::SLOT_2, uint16_t(slot));
+	if(status!=Fingerprint::OK)
+	{
+		fp->printError(status);
+		return Fingerprint::OK;
+	}
+	
+	library.assign(slot, id, QCryptographicHash::hash(fpTemplate, QCryptographicHash::Md5).toHex());
+	library.save();
+	snapshot.store(id, fpTemplate);
+	
+	return Fingerprint::OK;
+}
+
+
+void FpThread::enrollMode(Fingerprint* fp)
+{
+	static Fingerprint::Slot slot = Fingerprint::SLOT_1;
+	
+	Fingerprint::Status status;
+
+	if(QDateTime::currentDateTime() > enrollStartTime.addSecs(ENROLL_TIMEOUT))
+	{
+		qWarning() << "ENROLL timed out";
+		post(Event::ENROLL_FINISHED, -1, 0, false, false);
+		mode = NORMAL;
+		return;
+	}
+	
+	// free IDs are taken from the sensor library, keep it up to date with the database
+	// (only while the char buffers are not in use, template downloads overwrite them)
+	if(slot == Fingerprint::SLOT_1)
+	{
+		scheduler.runSlice(BACKGROUND_BUDGET);
+	}
+	
+	// try to generate image of finger
+	status=fp->genImage();
+	
+	// skip the trivial case NO_FINGER
+	if(status!=Fingerprint::NOFINGER)
+	{
+		// check for errors
+		if(status!=Fingerprint::OK)
+		{
+			// report error and try again next time
+			fp->printError(status);
+			return;
+		}
+		
+		qDebug() << "finger detected, creating feature file in slot" << slot;
+		
+		// try to create feature file from image
+		status=fp->image2Tz(slot);
+		if(status!=Fingerprint::OK)
+		{
+			// report error and try again next time
+			fp->printError(status);
+			return;
+		}
+		
+		if(slot == Fingerprint::SLOT_1)
+		{
+			qDebug() << "slot 1 successfull, continue with slot 2...";
+			slot = Fingerprint::SLOT_2;
+			return;
+		}
+
+		if(slot == Fingerprint::SLOT_2)
+		{
+			qDebug() << "slot 2 successfull, generate template...";
+
+			slot = Fingerprint::SLOT_1;
+			
+			status = fp->createModel();
+			if(status!=Fingerprint::OK)
+			{
+				// report error and try again next time
+				fp->printError(status);
+				return;
+			}
+
+			qDebug() << "template successfull, find free ID...";
+
+			int enrollID = databaseIds.findFirstFree();
+			int librarySlot = cache ? cache->allocate() : library.occupancy().findFirstFree();
+			if(enrollID < 0 || librarySlot < 0)
 			{
 				qWarning() << "ENROLL failed, out of memory!";
-				emit enrollFinished(-1, false);
+				post(Event::ENROLL_FINISHED, -1, 0, false, false);
 				mode = NORMAL;
+				return;
 			}
 
-			qDebug() << "found free id:" << enrollID << "save template on sensor...";
+			qDebug() << "found free id:" << enrollID << "save template on sensor in slot" << librarySlot << "...";
+			
+			if(!invalidateStamp(fp))
+			{
+				// try again next time
+				return;
+			}
+			library.save();		// an evicted slot is overwritten
 			
-			status = fp->storeModel(Fingerprint::SLOT_1, enrollID);
+			status = fp->storeModel(Fingerprint::SLOT_1, uint16_t(librarySlot));
 			if(status!=Fingerprint::OK)
 			{
 				// report error and try again next time
@@ -455,91 +1404,605 @@ void FpThread::enrollMode(Fingerprint* fp)
 
 			qDebug() << "upload successfull," << fpTemplate.size() << "bytes, save template in database...";
 
-			query.prepare("INSERT INTO fingerprint (id, template) VALUES (:id, :template)");
-			query.bindValue(":id", enrollID);
-			query.bindValue(":template", fpTemplate);
-			if(!query.exec())
+			// the ID and slot are reserved until the database has stored the template
+			databaseIds.insert(enrollID);
+			library.assign(librarySlot, enrollID, QCryptographicHash::hash(fpTemplate, QCryptographicHash::Md5).toHex());
+			library.save();
+			if(cache)
 			{
-				qCritical() << "ENROLL: failed to save template in database:" << query.lastError().text();
-				return;
+				cache->hit(enrollID);
 			}
-
-			fingerIds->insert(enrollID);
-
-			qDebug() << "ENROLL successfull!";
-			emit enrollFinished(enrollID, true);
 			mode=NORMAL;
+			
+			dbWorker.write("INSERT INTO fingerprint (id, template) VALUES (?, ?)", {enrollID, fpTemplate},
+					 [this, fp, enrollID, librarySlot, fpTemplate](bool ok, const DbWorker::Rows&)
+			{
+				if(!ok)
+				{
+					qCritical() << "ENROLL: failed to save template in database";
+					
+					// the ID may have been taken in the database meanwhile, the next update loads it
+					databaseIds.remove(enrollID);
+					hotBand->forget(enrollID);
+					if(cache)
+					{
+						cache->forget(enrollID);
+					}
+					if(library.idAt(librarySlot) == enrollID && invalidateStamp(fp))
+					{
+						fp->deleteModel(uint16_t(librarySlot), 1);
+						library.release(librarySlot);
+						library.save();
+					}
+					post(Event::ENROLL_FINISHED, -1, 0, false, false);
+					return;
+				}
+				
+				snapshot.store(enrollID, fpTemplate);
+				qDebug() << "ENROLL successfull!";
+				post(Event::ENROLL_FINISHED, enrollID, 0, true, false);
+			});
 		}
 	}
 }
 
 
-void FpThread::deleteMode(Fingerprint* fp)
+/*
+ * delete the IDs of the queued DELETE commands from database and sensor
+ * consecutive slots are deleted with one command
+ * one request at a time, after a failure the IDs are queued again and retried after DELETE_RETRY
+ */
+void FpThread::deleteTemplates(Fingerprint* fp)
 {
-	// remove entry from database
-	QSqlQuery query;
-	query.prepare("DELETE FROM fingerprint WHERE id=:id");
-	query.bindValue(":id", tempID);
-	if(!query.exec())
+	if(deletePending || (deleteFailed.isValid() && deleteFailed.elapsed() < DELETE_RETRY*1000))
 	{
-		qCritical() << "DELETE: failed to delete from database:" << query.lastError().text();
-		mode = NORMAL;
 		return;
 	}
+	
+	// the templates are removed from the sensor once the database entries are deleted
+	SlotBitmap ids = pendingDeletes;
+	pendingDeletes.clear();
+	deletePending = true;
+	
+	dbWorker.writeIds("DELETE FROM fingerprint WHERE id IN (?)", ids.toList(), [this, fp, ids](bool ok, const DbWorker::Rows&)
+	{
+		deletePending = false;
+		if(!ok)
+		{
+			qCritical() << "DELETE: failed to delete from database, retrying" << ids.count() << "ids";
+			pendingDeletes.unite(ids);
+			deleteFailed.start();
+			return;
+		}
+		deleteFailed.invalidate();
+		
+		SlotBitmap targets(library.capacity());
+		for(int id : ids.toList())
+		{
+			databaseIds.remove(id);
+			snapshot.remove(id);
+			hotBand->forget(id);
+			if(cache)
+			{
+				cache->forget(id);
+			}
+			targets.insert(library.slotOf(id));
+		}
+		
+		// try to delete templates on sensor, the next reconcile removes them if the stamp cannot be cleared
+		if(!targets.isEmpty() && invalidateStamp(fp))
+		{
+			for(const QPair<int, int>& range : targets.ranges())
+			{
+				Fingerprint::Status status;
+				status=fp->deleteModel(uint16_t(range.first), uint16_t(range.second));
+				if(status!=Fingerprint::OK)
+				{
+					// report error, the next reconcile removes the orphans
+					fp->printError(status);
+					continue;
+				}
+				
+				for(int slot = range.first; slot < range.first + range.second; slot++)
+				{
+					library.release(slot);
+				}
+			}
+			library.save();
+		}
+		
+		qDebug() << "DELETE" << ids.count() << "ids successfull";
+	});
+}
+
 
-	// try to delete template on sensor
+/*
+ * 1:1 verification of the next finger against the claimed identity verifyID
+ */
+void FpThread::verifyMode(Fingerprint* fp)
+{
 	Fingerprint::Status status;
-	status=fp->deleteModel(tempID, 1);
+	int id = verifyID;
+	
+	if(!verifyRepeat && QDateTime::currentDateTime() > verifyStartTime.addSecs(VERIFY_TIMEOUT))
+	{
+		qWarning() << "VERIFY timed out";
+		post(Event::VERIFY_FINISHED, id, 0, false, false);
+		mode = NORMAL;
+		return;
+	}
+	
+	// try to generate image of finger
+	status=fp->genImage();
+	scans++;
+	
+	if(status==Fingerprint::NOFINGER)
+	{
+		fingerLifted();
+		scheduler.runSlice(BACKGROUND_BUDGET);
+		waitForFinger();
+		return;
+	}
+	if(status!=Fingerprint::OK)
+	{
+		// report error and try again next time
+		fp->printError(status);
+		return;
+	}
+	governor->detected();
+	if(!identifyAgain())
+	{
+		return;
+	}
+	
+	qDebug() << "finger detected, verifying id" << id << "...";
+	
+	// the sensor extracts the features while a claimed template that is not cached is read from the snapshot
+	bool extracted=false;
+	fp->image2TzAsync(Fingerprint::SLOT_1, [&](Fingerprint::Status result, const QByteArray&)
+	{
+		status=result;
+		extracted=true;
+	});
+	
+	int slot = library.slotOf(id);
+	QByteArray claimed;
+	bool enrolled = (slot >= 0) || databaseIds.contains(id);
+	bool available = (slot >= 0) || readTemplate(id, claimed);
+	
+	while(!extracted)
+	{
+		fp->processEvents();
+	}
 	if(status!=Fingerprint::OK)
 	{
-		// report error
+		// report error and try again next time
 		fp->printError(status);
+		return;
+	}
+	
+	if(!enrolled)
+	{
+		qWarning() << "VERIFY: id" << id << "is not enrolled";
+		post(Event::VERIFY_FINISHED, id, 0, false, false);
 		mode = NORMAL;
 		return;
 	}
+	
+	if(!available)
+	{
+		if(verifyFetch == id && !verifyFetchPending)
+		{
+			// the template was requested once and still cannot be read
+			qWarning() << "VERIFY: template" << id << "is not available";
+			post(Event::VERIFY_FINISHED, id, 0, false, false);
+			mode = NORMAL;
+			return;
+		}
+		
+		// the finger is verified again once the template was copied to the snapshot, one request per id
+		if(verifyFetch != id && fetchTemplates(QList<int>() << id))
+		{
+			qDebug() << "VERIFY: template" << id << "is not in the snapshot yet, copying it from the database";
+			verifyFetch = id;
+			verifyFetchPending = true;
+		}
+		scheduler.runSlice(BACKGROUND_BUDGET);
+		return;
+	}
+	
+	QElapsedTimer timer;
+	timer.start();
+	
+	// load the claimed template into SLOT_2 and compare it with SLOT_1
+	uint16_t score=0;
+	QByteArray reply;
+	status = fp->complete([&](Fingerprint::Callback done)
+	{
+		fp->sequence(
+		{
+			[&](Fingerprint::Callback next)
+			{
+				if(slot >= 0)
+				{
+					fp->loadModelAsync(Fingerprint::SLOT_2, uint16_t(slot), next);
+				}
+				else
+				{
+					fp->downCharAsync(Fingerprint::SLOT_2, claimed, next);
+				}
+			},
+			[&](Fingerprint::Callback next)
+			{
+				fp->matchAsync([&score, next](Fingerprint::Status result, uint16_t matchScore)
+				{
+					score = matchScore;
+					next(result, QByteArray());
+				});
+			}
+		}, done);
+	}, reply);
+	if(status!=Fingerprint::OK && status!=Fingerprint::NOMATCH)
+	{
+		fp->printError(status);
+		return;
+	}
+	
+	bool success = (status==Fingerprint::OK);
+	bool button = (gpio && gpio->read(Gpio::BUTTON) == 0);		// invert button signal
+	qDebug() << "VERIFY id:" << id << (success ? "MATCH" : "NO MATCH") << "score:" << score << "in" << timer.elapsed()
+			 << "ms, median search time" << hotBand->medianTime() << "ms";
+	
+	if(success)
+	{
+		if(cache)
+		{
+			cache->hit(id);
+		}
+		hotBand->matched(id);
+	}
+	
+	post(Event::VERIFY_FINISHED, id, score, success, button);
+	identified();
+	if(!verifyRepeat)
+	{
+		mode = NORMAL;
+	}
+}
+
+
+/*
+ * genImage() reported no finger, the next finger is identified
+ */
+void FpThread::fingerLifted()
+{
+	if(presence == PRESENT)
+	{
+		qDebug() << "finger lifted";
+		presence = ARMED;
+	}
+}
+
 
-	fingerIds->remove(tempID);
+/*
+ * a finger is on the sensor
+ * return value: true if it has to be identified: it was just placed or the re-trigger policy applies
+ */
+bool FpThread::identifyAgain()
+{
+	if(presence == ARMED)
+	{
+		return true;
+	}
 	
-	qDebug() << "DELETE id:" << tempID << "successfull";
-	mode = NORMAL;
-	return;
+	if(RETRIGGER_INTERVAL > 0 && QDateTime::currentDateTime() >= presenceTime.addSecs(RETRIGGER_INTERVAL))
+	{
+		qDebug() << "finger still present after" << RETRIGGER_INTERVAL << "s, identify again";
+		return true;
+	}
+	
+	if(RETRIGGER_BUTTON && gpio && (gpio->read(Gpio::BUTTON) == 0) != presenceButton)
+	{
+		qDebug() << "button changed while the finger is present, identify again";
+		return true;
+	}
+	
+	return false;
 }
 
 
-void FpThread::enroll(bool run)
+/*
+ * the present finger was identified, it is not searched again until it is lifted
+ */
+void FpThread::identified()
+{
+	presence = PRESENT;
+	presenceTime = QDateTime::currentDateTime();
+	presenceButton = (gpio && gpio->read(Gpio::BUTTON) == 0);		// invert button signal
+}
+
+
+/*
+ * read the template of <id> from the snapshot
+ * return value: false if <id> is not in the database or its template is not in the snapshot yet
+ */
+bool FpThread::readTemplate(int id, QByteArray& fpTemplate)
 {
-	if(run)
+	if(!databaseIds.contains(id) || !snapshot.contains(id))
 	{
-		qDebug() << "ENROLL new finger...";
-		enrollStartTime = QDateTime::currentDateTime();
-		mode = ENROLL;
+		return false;
 	}
-	else
+	
+	fpTemplate = snapshot.fpTemplate(id);
+	return true;
+}
+
+
+/*
+ * read IDs and template hashes from the database, <done> is called by DbWorker::deliver()
+ */
+void FpThread::readDatabase(Hashes done)
+{
+	dbWorker.query("SELECT id, MD5(template) FROM fingerprint", QVariantList(), [done](bool ok, const DbWorker::Rows& rows)
 	{
-		qDebug() << "ENROLL aborted";
-		mode = NORMAL;
-		emit enrollFinished(-1, false);
+		QHash<int, QByteArray> hashes;
+		if(!ok)
+		{
+			qCritical() << "failed to read template hashes from database";
+			done(false, hashes);
+			return;
+		}
+		
+		for(const QVariantList& row : rows)
+		{
+			hashes.insert(row[0].toInt(), row[1].toByteArray());
+		}
+		done(true, hashes);
+	});
+}
+
+
+/*
+ * measure throughput of template transfers (upChar, downChar) on the serial link
+ */
+void FpThread::benchmarkLink(Fingerprint* fp)
+{
+	const int rounds = 10;
+	QByteArray fpTemplate;
+	QElapsedTimer timer;
+	Fingerprint::Status status;
+	
+	timer.start();
+	for(int i=0; i<rounds; i++)
+	{
+		status = fp->upChar(Fingerprint::SLOT_1, fpTemplate);
+		if(status!=Fingerprint::OK)
+		{
+			fp->printError(status);
+			return;
+		}
+	}
+	qint64 upTime = timer.restart();
+	
+	for(int i=0; i<rounds; i++)
+	{
+		status = fp->downChar(Fingerprint::SLOT_1, fpTemplate);
+		if(status!=Fingerprint::OK)
+		{
+			fp->printError(status);
+			return;
+		}
+	}
+	qint64 downTime = timer.elapsed();
+	
+	qDebug() << "link benchmark at" << fp->baudRate() << "baud:";
+	qDebug() << "\tupChar:" << upTime/rounds << "ms," << (upTime > 0 ? fpTemplate.size()*rounds*1000/upTime : 0) << "bytes/s";
+	qDebug() << "\tdownChar:" << downTime/rounds << "ms," << (downTime > 0 ? fpTemplate.size()*rounds*1000/downTime : 0) << "bytes/s";
+}
+
+
+/*
+ * compare the sensor library with all templates in the database and transfer the difference
+ * checkSensor: read the sensor index table, otherwise the recorded library content is used
+ * return value: true if the sensor library is in sync with the database
+ */
+bool FpThread::reconcile(Fingerprint* fp, const QHash<int, QByteArray>& dbHashes, bool checkSensor)
+{
+	Reconciler reconciler(fp, &library, !cache.isNull(), &snapshot);
+	if(checkSensor && !reconciler.readSensor())
+	{
+		qWarning() << "reconcile: index table not available, using known library content";
+		
+		if(library.count() == 0)
+		{
+			// nothing known about the sensor library, start with an empty library
+			if(!invalidateStamp(fp))
+			{
+				return false;
+			}
+			Fingerprint::Status status = fp->emptyDatabase();
+			if(status!=Fingerprint::OK)
+			{
+				fp->printError(status);
+				return false;
+			}
+		}
+	}
+	
+	reconciler.compare(dbHashes);
+	return transfer(fp, reconciler);
+}
+
+
+/*
+ * delete orphans and load missing templates found by <reconciler>
+ * return value: true if the sensor library is in sync with the database
+ */
+bool FpThread::transfer(Fingerprint* fp, Reconciler& reconciler)
+{
+	if(!reconciler.isInSync())
+	{
+		if(!invalidateStamp(fp))
+		{
+			return false;
+		}
+		
+		int deleted = reconciler.removeOrphans();
+		int loaded = reconciler.loadMissing(RECONCILE_BATCH);
+		
+		qDebug() << "reconcile:" << loaded << "templates loaded," << deleted << "deleted";
+		
+		// the rest is loaded by the next slices (the changes are not acknowledged, the full reconcile is continued)
+		if(loaded == RECONCILE_BATCH && !reconciler.isInSync())
+		{
+			scheduler.trigger(syncTask);
+		}
+		
+		// templates that are not in the snapshot are copied from the database, the next update loads them
+		if(online)
+		{
+			fetchTemplates(reconciler.unavailable().mid(0, FETCH_BATCH));
+		}
+	}
+	
+	return reconciler.isInSync();
+}
+
+
+/*
+ * IDs in the database that can be used, invalid IDs are reported
+ */
+SlotBitmap FpThread::validIds(const QHash<int, QByteArray>& hashes)
+{
+	SlotBitmap ids(MAX_TEMPLATES);
+	for(int id : hashes.keys())
+	{
+		if(!ids.insert(id))
+		{
+			qCritical() << "invalid id in database, ignored:" << id;
+		}
+	}
+	return ids;
+}
+
+
+/*
+ * the stamp identifies the library content recorded in the state file,
+ * it is stored in the sensor notepad when the sensor library is not being changed
+ */
+QByteArray FpThread::libraryStamp()
+{
+	uint16_t count = uint16_t(library.count());
+	
+	// stamp format: magic, version, number of templates, SHA1 hash of the library content
+	QByteArray stamp = QByteArray(STAMP_MAGIC).append(char(STAMP_VERSION)).append(char(count>>8)).append(char(count & 0xFF));
+	stamp.append(library.digest());
+	return stamp;
+}
+
+
+/*
+ * mark the sensor library as matching the recorded content
+ */
+void FpThread::writeStamp(Fingerprint* fp)
+{
+	Fingerprint::Status status = fp->writeNotepad(STAMP_PAGE, libraryStamp());
+	if(status!=Fingerprint::OK)
+	{
+		fp->printError(status);
+		return;
+	}
+	
+	qDebug() << "library stamp updated";
+	stampValid = true;
+}
+
+
+/*
+ * clear the stamp before the sensor library is modified
+ * return value: false if the stamp could not be cleared, the sensor library must not be changed
+ */
+bool FpThread::invalidateStamp(Fingerprint* fp)
+{
+	if(!stampValid)
+	{
+		return true;
+	}
+	
+	Fingerprint::Status status = fp->writeNotepad(STAMP_PAGE, QByteArray());
+	if(status!=Fingerprint::OK)
+	{
+		fp->printError(status);
+		return false;
 	}
+	
+	stampValid = false;
+	return true;
+}
+
+
+void FpThread::enroll(bool run)
+{
+	Command command = {};
+	command.type = run ? Command::ENROLL : Command::ABORT_ENROLL;
+	queue(command);
 }
 
 
 void FpThread::del(int id)
 {
-	if(id < 0 || id >= MAX_FINGERS)
+	Command command = {};
+	command.type = Command::DELETE;
+	command.id = id;
+	queue(command);
+}
+
+
+/*
+ * verify the next finger against <id> instead of searching the library
+ * repeat: stay in VERIFY mode (e.g. single-occupant door), until search() is called
+ */
+void FpThread::verify(int id, bool repeat)
+{
+	if(id < 0)
 	{
-		qWarning() << "DELETE: invalid id:" << id;
+		qWarning() << "VERIFY: invalid id:" << id;
+		emit verifyFinished(id, false, 0, false);
 		return;
 	}
 	
-	tempID = uint16_t(id);
-	mode = DELETE;
+	Command command = {};
+	command.type = Command::VERIFY;
+	command.id = id;
+	command.repeat = repeat;
+	queue(command);
+}
+
+
+/*
+ * back to 1:N search of the library
+ */
+void FpThread::search()
+{
+	Command command = {};
+	command.type = Command::SEARCH;
+	queue(command);
+}
+
+
+/*
+ * the database was changed, check the change log at the next update
+ */
+void FpThread::syncNow()
+{
+	Command command = {};
+	command.type = Command::SYNC;
+	queue(command);
 }
 
 
 
 FpThread::~FpThread()
 {
-	QSqlDatabase db = QSqlDatabase::database();
-	db.close();
-	QSqlDatabase::removeDatabase(db.connectionName());
+	close(wakeFd);
 }
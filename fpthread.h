@@ -3,8 +3,25 @@
 
 #include <QThread>
 #include <QSet>
+#include <QHash>
+#include <QQueue>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QScopedPointer>
 #include "fingerprint.h"
+#include "changelog.h"
+#include "dbworker.h"
+#include "slotbitmap.h"
+#include "sensorlibrary.h"
+#include "templatecache.h"
+#include "hotband.h"
+#include "spscqueue.h"
+#include "snapshot.h"
+#include "taskscheduler.h"
+#include "scangovernor.h"
+
+class Gpio;
+class Reconciler;
 
 class FpThread : public QThread
 {
@@ -13,35 +30,167 @@ public:
 	explicit FpThread(QObject *parent = nullptr);
 	~FpThread();
 	
-	enum Mode {NORMAL = 0, ENROLL = 1, DELETE = 2};
+	enum Mode {NORMAL = 0, ENROLL = 1, VERIFY = 2};
+	enum Presence {ARMED = 0, PRESENT = 1};		// ARMED: waiting for a finger, PRESENT: finger identified, waiting until it is lifted
+	
+	void setGpio(Gpio* gpio) {this->gpio = gpio;}		// call before start()
 	
 public slots:
+	// called from the main thread, the commands are queued for the sensor thread
 	void enroll(bool run);
 	void del(int id);
+	void syncNow();
+	void verify(int id, bool repeat);
+	void search();
 	
 signals:
 	void match(int id, int score, bool button);
 	void enrollFinished(int id, bool success);
+	void verifyFinished(int id, bool success, int score, bool button);
 	
+private slots:
+	void deliverEvents();
 	
 private:
+	// command from the main thread
+	struct Command
+	{
+		enum Type {ENROLL, ABORT_ENROLL, DELETE, SYNC, VERIFY, SEARCH};
+		Type type;
+		int id;
+		bool repeat;
+	};
+	
+	// event for the main thread
+	struct Event
+	{
+		enum Type {MATCH, ENROLL_FINISHED, VERIFY_FINISHED};
+		Type type;
+		int id;
+		int score;
+		bool success;
+		bool button;
+	};
 	
-	volatile Mode mode;
-	volatile uint16_t tempID;
-	QSet<int>* fingerIds;
+	SpscQueue<Command, 256> commands;	// main thread -> sensor thread
+	SpscQueue<Event, 64> events;		// sensor thread -> main thread
+	QAtomicInt eventsPending;			// deliverEvents() is scheduled
+	SlotBitmap pendingDeletes;			// IDs of queued DELETE commands
+	bool deletePending;					// a DELETE request of the database is not completed
+	QElapsedTimer deleteFailed;			// time since the last failed DELETE, the IDs are deleted again after DELETE_RETRY
+	QQueue<Command> overflow;			// commands that did not fit into the queue (main thread)
+	bool flushScheduled;				// flushCommands() is scheduled (main thread)
+	QQueue<Event> eventOverflow;		// events that did not fit into the queue (sensor thread)
+	
+	Mode mode;
+	int verifyID;				// claimed identity in VERIFY mode
+	bool verifyRepeat;			// stay in VERIFY mode after a verification
+	int verifyFetch;			// claimed template requested from the database for the snapshot, -1 if none
+	bool verifyFetchPending;	// the request for verifyFetch is not completed
+	SensorLibrary library;		// content of the sensor library
+	QScopedPointer<TemplateCache> cache;	// sensor library as cache of the database (TIERED_CACHE)
+	QScopedPointer<HotBand> hotBand;		// frequently matched templates in the low slots, searched first
+	SlotBitmap databaseIds;		// IDs in the database
+	bool stampValid;			// the stamp in the sensor notepad matches the library content
 	QDateTime enrollStartTime;
+	QDateTime verifyStartTime;
+	Presence presence;
+	QDateTime presenceTime;		// time of the last identification of the present finger
+	bool presenceButton;		// button state at the last identification
+	Gpio* gpio;					// owned by FpMain
+	DbWorker dbWorker;			// declared before changeLog, which uses it
+	ChangeLog changeLog;
+	bool updatePending;			// a database request of update() is not completed
+	bool online;				// the sensor library was synchronized with the database since it became available
+	int syncConnection;			// connection number of the database worker at the last synchronization
+	bool firstSync;				// the first synchronization was not answered yet, the start is offline if it fails
+	bool syncIncomplete;		// the full reconcile is continued with syncHashes by the next update
+	QHash<int, QByteArray> syncHashes;	// template hashes of the database for the incomplete reconcile
+	TemplateSnapshot snapshot;	// local copy of the templates in the database
+	bool snapshotPending;		// templates for the snapshot are requested
+	int snapshotCursor;			// next ID checked by fillSnapshot()
+	TaskScheduler scheduler;	// background work between the finger scans
+	int syncTask;				// scheduler task that checks the database for changes
+	int wakeFd;					// eventfd, wakes the sensor thread while it waits for a touch
+	bool touchWakeup;			// the finger scan waits for touch events of the sensor
+	QElapsedTimer touchTime;	// time since the last touch event
+	QScopedPointer<ScanGovernor> governor;	// scan rate without touch events
+	int scans;					// number of finger scans since the last statistics
+	qint64 cpuTime;				// (nanoseconds) CPU time of the sensor thread at the last statistics
+	QElapsedTimer statsTime;	// time since the last statistics
 	
 	void run();
+	void queue(const Command& command);
+	void flushCommands();
+	void wake();
+	void processCommands(Fingerprint* fp);
+	void post(Event::Type type, int id, int score, bool success, bool button);
+	void flushEvents();
+	void scheduleDelivery();
 	void normalMode(Fingerprint* fp);
 	void enrollMode(Fingerprint* fp);
-	void deleteMode(Fingerprint* fp);
+	void deleteTemplates(Fingerprint* fp);
+	void verifyMode(Fingerprint* fp);
+	void waitForFinger();
+	void reportStatistics();
+	void fingerLifted();
+	bool identifyAgain();
+	void identified();
+	bool readTemplate(int id, QByteArray& fpTemplate);
+	
+	typedef std::function<void(bool ok, const QHash<int, QByteArray>& hashes)> Hashes;
+	
+	void updateFromChangeLog(Fingerprint* fp);
+	void updateFromDatabase(Fingerprint* fp);
+	void readChanges(Fingerprint* fp, const QSet<int>& ids);
+	bool applyChanges(Fingerprint* fp, const QSet<int>& ids, QHash<int, QByteArray> dbHashes);
+	void addTasks(Fingerprint* fp);
+	bool update(Fingerprint* fp);
+	void synchronize(Fingerprint* fp);
+	void reconcileAll(Fingerprint* fp, const QHash<int, QByteArray>& dbHashes, bool checkSensor);
+	void startOffline(Fingerprint* fp);
+	void checkConnection();
+	QHash<int, QByteArray> knownHashes();
+	void fillSnapshot();
+	bool fetchTemplates(const QList<int>& ids);
+	void failVerify();
+	bool findHole(int& from, int& to);
+	void compact(Fingerprint* fp);
+	void relocate(Fingerprint* fp);
+	
+	void reportMatch(int id, int score);
+	Fingerprint::Status pageIn(Fingerprint* fp, int& id, uint16_t& score);
+	
+	void benchmarkLink(Fingerprint* fp);
+	bool reconcile(Fingerprint* fp, const QHash<int, QByteArray>& dbHashes, bool checkSensor);
+	bool transfer(Fingerprint* fp, Reconciler& reconciler);
+	SlotBitmap validIds(const QHash<int, QByteArray>& hashes);
+	void readDatabase(Hashes done);
+	
+	QByteArray libraryStamp();
+	void writeStamp(Fingerprint* fp);
+	bool invalidateStamp(Fingerprint* fp);
 	
 	// configuration
 	uint16_t MAX_FINGERS;		// capacitiy of fingerprint library
+	bool TIERED_CACHE;			// the database holds more templates than the sensor, the sensor library is a cache
+	int MAX_TEMPLATES;			// number of database IDs (TIERED_CACHE), otherwise MAX_FINGERS
+	int CACHE_PAGE_LIMIT;		// number of templates matched 1:1 after a cache miss (0: all)
+	int CACHE_PAGE_TIME;		// (milliseconds) time limit of the 1:1 matches after a cache miss (0: none)
+	int HOT_BAND_SIZE;			// number of slots searched first, filled with the most frequent matches (0: single search)
 	uint32_t ENROLL_TIMEOUT;	// (seconds) timeout for enroll mode
-	QString DATABASE_NAME;		// name of database
-	QString DATABASE_USER;		// user name for database
-	QString DATABASE_PASSWD;	// password for database user
+	uint32_t VERIFY_TIMEOUT;	// (seconds) timeout for a single verification
+	int RETRIGGER_INTERVAL;		// (seconds) a finger that stays on the sensor is identified again after this time (0: once per placement)
+	bool RETRIGGER_BUTTON;		// a finger that stays on the sensor is identified again when the button changes
+	int BACKGROUND_BUDGET;		// (milliseconds) time for background work between two finger scans
+	bool TOUCH_WAKEUP;			// scan for a finger only after a touch event of the sensor (GPIO_TOUCH)
+	int IDLE_HEARTBEAT;			// (milliseconds) scan interval while waiting for touch events
+	int SCAN_INTERVAL_MIN;		// (milliseconds) pause between two scans at the full rate
+	int SCAN_INTERVAL_MAX;		// (milliseconds) pause between two scans while idle, bounds the detection latency
+	int IDLE_BACKOFF;			// (seconds) time without finger or command until the scan rate is lowered
+	QString FULL_RATE_WINDOWS;	// time windows with the full scan rate, "hh:mm-hh:mm,..."
+	bool BENCHMARK_LINK;		// measure template transfer throughput at startup
+	uint32_t SYNC_INTERVAL;		// (seconds) interval for checking the change log of the database
 };
 
 #endif // FPTHREAD_H
@@ -0,0 +1,39 @@
+#include "gpio.h"
+#include "gpiochardev.h"
+#include "gpiofake.h"
+
+#include <QDebug>
+#include <QSettings>
+
+
+/*
+ * GPIO_BACKEND = chardev: Linux GPIO character device and sysfs PWM
+ * GPIO_BACKEND = fake: files in GPIO_FAKE_DIR
+ */
+Gpio* Gpio::create(QSettings& conf)
+{
+	QString backend = conf.value("GPIO_BACKEND", "chardev").toString();
+	
+	if(backend == "fake")
+	{
+		return new GpioFake(conf.value("GPIO_FAKE_DIR", "/tmp/fp-server-gpio").toString());
+	}
+	
+	if(backend != "chardev")
+	{
+		qWarning() << "GPIO: unknown backend" << backend << ", using chardev";
+	}
+	
+	// BCM line numbers, defaults match the shield (wiringPi pins 4, 5, 7 and PWM 1)
+	int lines[3];
+	lines[LED_GREEN] = conf.value("GPIO_LED_GREEN", 23).toInt();
+	lines[LED_RED] = conf.value("GPIO_LED_RED", 24).toInt();
+	lines[BUTTON] = conf.value("GPIO_BUTTON", 4).toInt();
+	
+	return new GpioChardev(conf.value("GPIO_CHIP", "/dev/gpiochip0").toString(), lines,
+						   conf.value("PWM_CHIP", "/sys/class/pwm/pwmchip0").toString(),
+						   conf.value("PWM_CHANNEL", 0).toInt(),
+						   conf.value("PWM_PERIOD", 1000000).toUInt(),
+						   conf.value("GPIO_TOUCH", -1).toInt(),
+						   conf.value("GPIO_TOUCH_ACTIVE_LOW", false).toBool());
+}
@@ -0,0 +1,34 @@
+#ifndef GPIO_H
+#define GPIO_H
+
+#include <stdint.h>
+
+class QSettings;
+
+/*
+ * access to the GPIOs of the door lock shield: door buzzer (PWM), LEDs and sensor button
+ */
+class Gpio
+{
+public:
+	
+	enum Pin {LED_GREEN=0, LED_RED=1, BUTTON=2};
+	
+	static const uint32_t PWM_RANGE=1024;		// full scale of PWM duty cycle
+	
+	virtual ~Gpio() {}
+	
+	virtual bool setup() = 0;
+	virtual bool write(Pin pin, bool value) = 0;
+	virtual int read(Pin pin) = 0;						// value of pin, -1 in case of error
+	virtual bool setBuzzer(uint32_t duty) = 0;			// duty cycle 0...PWM_RANGE
+	
+	// touch output of the sensor (optional), signaled by edge events
+	virtual int touchFd() { return -1; }				// file descriptor that becomes readable at a touch, -1 if not available
+	virtual bool readTouch() { return false; }			// consume the pending events, return value: true if the sensor was touched
+	
+	// create backend according to configuration
+	static Gpio* create(QSettings& conf);
+};
+
+#endif // GPIO_H
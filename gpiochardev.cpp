@@ -0,0 +1,233 @@
+#include "gpiochardev.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QThread>
+
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+
+GpioChardev::GpioChardev(const QString& chip, const int lines[3], const QString& pwmChip, int pwmChannel, uint32_t pwmPeriod,
+						 int touchLine, bool touchActiveLow)
+{
+	this->chip = chip;
+	for(int i=0; i<3; i++)
+	{
+		this->lines[i] = lines[i];
+		fds[i] = -1;
+	}
+	this->pwmChannel = pwmChannel;
+	this->pwmPeriod = pwmPeriod;
+	pwmPath = QString("%1/pwm%2").arg(pwmChip).arg(pwmChannel);
+	dutyFd = -1;
+	this->touchLine = touchLine;
+	this->touchActiveLow = touchActiveLow;
+	touchEventFd = -1;
+}
+
+
+GpioChardev::~GpioChardev()
+{
+	for(int i=0; i<3; i++)
+	{
+		if(fds[i] >= 0)
+		{
+			close(fds[i]);
+		}
+	}
+	if(dutyFd >= 0)
+	{
+		close(dutyFd);
+	}
+	if(touchEventFd >= 0)
+	{
+		close(touchEventFd);
+	}
+}
+
+
+bool GpioChardev::setup()
+{
+	bool ok = requestLine(LED_GREEN, true);
+	ok &= requestLine(LED_RED, true);
+	ok &= requestLine(BUTTON, false);
+	if(touchLine >= 0)
+	{
+		ok &= requestTouchEvents();
+	}
+	
+	// export PWM channel
+	if(!QFile::exists(pwmPath))
+	{
+		writeSysfs(pwmPath.section('/', 0, -2) + "/export", QByteArray::number(pwmChannel));
+		
+		// the attributes appear asynchronously after export
+		for(int i=0; i<50 && !QFile::exists(pwmPath + "/enable"); i++)
+		{
+			QThread::msleep(10);
+		}
+	}
+	
+	writeSysfs(pwmPath + "/duty_cycle", "0");
+	ok &= writeSysfs(pwmPath + "/period", QByteArray::number(pwmPeriod));
+	ok &= writeSysfs(pwmPath + "/enable", "1");
+	
+	dutyFd = open((pwmPath + "/duty_cycle").toLocal8Bit().constData(), O_WRONLY);
+	if(dutyFd < 0)
+	{
+		qCritical() << "GPIO: cannot open" << pwmPath + "/duty_cycle";
+		ok = false;
+	}
+	
+	return ok;
+}
+
+
+bool GpioChardev::write(Pin pin, bool value)
+{
+	if(fds[pin] < 0)
+	{
+		return false;
+	}
+	
+	struct gpiohandle_data data = {};
+	data.values[0] = value ? 1 : 0;
+	return ioctl(fds[pin], GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) == 0;
+}
+
+
+int GpioChardev::read(Pin pin)
+{
+	if(fds[pin] < 0)
+	{
+		return -1;
+	}
+	
+	struct gpiohandle_data data = {};
+	if(ioctl(fds[pin], GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) != 0)
+	{
+		return -1;
+	}
+	return data.values[0];
+}
+
+
+bool GpioChardev::setBuzzer(uint32_t duty)
+{
+	if(dutyFd < 0)
+	{
+		return false;
+	}
+	
+	if(duty > PWM_RANGE)
+	{
+		duty = PWM_RANGE;
+	}
+	
+	QByteArray value = QByteArray::number(qulonglong(pwmPeriod) * duty / PWM_RANGE);
+	return pwrite(dutyFd, value.constData(), size_t(value.size()), 0) == value.size();
+}
+
+
+/*
+ * read the pending edge events of the touch output
+ * return value: true if a finger touched the sensor since the last call
+ */
+bool GpioChardev::readTouch()
+{
+	if(touchEventFd < 0)
+	{
+		return false;
+	}
+	
+	bool touched = false;
+	struct gpioevent_data event;
+	while(::read(touchEventFd, &event, sizeof(event)) == sizeof(event))
+	{
+		touched = true;
+	}
+	return touched;
+}
+
+
+/************************************************************/
+/*					private functions:						*/
+/************************************************************/
+
+bool GpioChardev::requestLine(Pin pin, bool output)
+{
+	int chipFd = open(chip.toLocal8Bit().constData(), O_RDWR | O_CLOEXEC);
+	if(chipFd < 0)
+	{
+		qCritical() << "GPIO: cannot open" << chip;
+		return false;
+	}
+	
+	struct gpiohandle_request request = {};
+	request.lineoffsets[0] = uint32_t(lines[pin]);
+	request.lines = 1;
+	request.flags = output ? GPIOHANDLE_REQUEST_OUTPUT : GPIOHANDLE_REQUEST_INPUT;
+	snprintf(request.consumer_label, sizeof(request.consumer_label), "fp-server");
+	
+	int result = ioctl(chipFd, GPIO_GET_LINEHANDLE_IOCTL, &request);
+	close(chipFd);
+	
+	if(result != 0)
+	{
+		qCritical() << "GPIO: cannot request line" << lines[pin] << "of" << chip;
+		return false;
+	}
+	
+	fds[pin] = request.fd;
+	return true;
+}
+
+
+/*
+ * request edge events of the touch output, only the edge of a touch is reported
+ */
+bool GpioChardev::requestTouchEvents()
+{
+	int chipFd = open(chip.toLocal8Bit().constData(), O_RDWR | O_CLOEXEC);
+	if(chipFd < 0)
+	{
+		qCritical() << "GPIO: cannot open" << chip;
+		return false;
+	}
+	
+	struct gpioevent_request request = {};
+	request.lineoffset = uint32_t(touchLine);
+	request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	request.eventflags = touchActiveLow ? GPIOEVENT_REQUEST_FALLING_EDGE : GPIOEVENT_REQUEST_RISING_EDGE;
+	snprintf(request.consumer_label, sizeof(request.consumer_label), "fp-server");
+	
+	int result = ioctl(chipFd, GPIO_GET_LINEEVENT_IOCTL, &request);
+	close(chipFd);
+	
+	if(result != 0)
+	{
+		qCritical() << "GPIO: cannot request events of line" << touchLine << "of" << chip;
+		return false;
+	}
+	
+	// events are read without blocking, the sensor thread waits with poll()
+	fcntl(request.fd, F_SETFL, fcntl(request.fd, F_GETFL) | O_NONBLOCK);
+	touchEventFd = request.fd;
+	return true;
+}
+
+
+bool GpioChardev::writeSysfs(const QString& path, const QByteArray& value)
+{
+	QFile file(path);
+	if(!file.open(QIODevice::WriteOnly) || file.write(value) != value.size())
+	{
+		qCritical() << "GPIO: cannot write" << value << "to" << path;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,46 @@
+#ifndef GPIOCHARDEV_H
+#define GPIOCHARDEV_H
+
+#include <QString>
+
+#include "gpio.h"
+
+/*
+ * GPIO access using the Linux GPIO character device, PWM using sysfs
+ * 
+ * All lines are requested once at setup, afterwards every access is a single ioctl()/write()
+ */
+class GpioChardev : public Gpio
+{
+public:
+	GpioChardev(const QString& chip, const int lines[3], const QString& pwmChip, int pwmChannel, uint32_t pwmPeriod,
+				int touchLine=-1, bool touchActiveLow=false);
+	~GpioChardev();
+	
+	bool setup();
+	bool write(Pin pin, bool value);
+	int read(Pin pin);
+	bool setBuzzer(uint32_t duty);
+	int touchFd() { return touchEventFd; }
+	bool readTouch();
+	
+private:
+	bool requestLine(Pin pin, bool output);
+	bool requestTouchEvents();
+	bool writeSysfs(const QString& path, const QByteArray& value);
+	
+	QString chip;			// GPIO character device
+	int lines[3];			// line offsets of LED_GREEN, LED_RED, BUTTON
+	int fds[3];				// line handles
+	
+	QString pwmPath;		// sysfs directory of the PWM channel
+	int pwmChannel;
+	uint32_t pwmPeriod;		// (nanoseconds)
+	int dutyFd;				// duty_cycle attribute, kept open
+	
+	int touchLine;			// line offset of the touch output of the sensor, -1 if not connected
+	bool touchActiveLow;	// the touch output is low while a finger is on the sensor
+	int touchEventFd;		// line event handle of the touch output
+};
+
+#endif // GPIOCHARDEV_H
@@ -0,0 +1,109 @@
+#include "gpiofake.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+static const char* const pinNames[] = {"green", "red", "button"};
+
+
+GpioFake::GpioFake(const QString& dir)
+{
+	this->dir = dir;
+	touchPipe = -1;
+}
+
+
+GpioFake::~GpioFake()
+{
+	if(touchPipe >= 0)
+	{
+		close(touchPipe);
+	}
+}
+
+
+bool GpioFake::setup()
+{
+	if(!QDir().mkpath(dir))
+	{
+		qCritical() << "GPIO: cannot create directory" << dir;
+		return false;
+	}
+	
+	// button released (input is active low)
+	if(!QFile::exists(dir + "/button"))
+	{
+		writeFile("button", "1");
+	}
+	
+	// touch edges, opened for writing as well so the pipe does not signal end of file without writers
+	QByteArray touchPath = (dir + "/touch").toLocal8Bit();
+	if(!QFile::exists(dir + "/touch") && mkfifo(touchPath.constData(), 0666) != 0)
+	{
+		qWarning() << "GPIO: cannot create" << dir + "/touch";
+	}
+	touchPipe = open(touchPath.constData(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	
+	qDebug() << "GPIO: using fake GPIOs in" << dir;
+	return true;
+}
+
+
+bool GpioFake::write(Pin pin, bool value)
+{
+	return writeFile(pinNames[pin], value ? "1" : "0");
+}
+
+
+int GpioFake::read(Pin pin)
+{
+	QFile file(dir + "/" + pinNames[pin]);
+	if(!file.open(QIODevice::ReadOnly))
+	{
+		return -1;
+	}
+	
+	bool ok;
+	int value = file.readAll().trimmed().toInt(&ok);
+	return ok ? value : -1;
+}
+
+
+bool GpioFake::setBuzzer(uint32_t duty)
+{
+	return writeFile("buzzer", QByteArray::number(duty));
+}
+
+
+bool GpioFake::readTouch()
+{
+	if(touchPipe < 0)
+	{
+		return false;
+	}
+	
+	bool touched = false;
+	char buffer[64];
+	while(::read(touchPipe, buffer, sizeof(buffer)) > 0)
+	{
+		touched = true;
+	}
+	return touched;
+}
+
+
+bool GpioFake::writeFile(const QString& name, const QByteArray& value)
+{
+	QFile file(dir + "/" + name);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		return false;
+	}
+	return file.write(value) == value.size();
+}
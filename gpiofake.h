@@ -0,0 +1,35 @@
+#ifndef GPIOFAKE_H
+#define GPIOFAKE_H
+
+#include <QString>
+
+#include "gpio.h"
+
+/*
+ * file backed GPIO for testing without hardware
+ * 
+ * Every pin is a file in <dir> containing its value (green, red, button, buzzer).
+ * Outputs are written to the files, the button is read from its file.
+ * The touch output is a named pipe (touch), every byte written to it is a touch edge.
+ */
+class GpioFake : public Gpio
+{
+public:
+	explicit GpioFake(const QString& dir);
+	~GpioFake();
+	
+	bool setup();
+	bool write(Pin pin, bool value);
+	int read(Pin pin);
+	bool setBuzzer(uint32_t duty);
+	int touchFd() { return touchPipe; }
+	bool readTouch();
+	
+private:
+	bool writeFile(const QString& name, const QByteArray& value);
+	
+	QString dir;
+	int touchPipe;		// read end of the touch pipe
+};
+
+#endif // GPIOFAKE_H
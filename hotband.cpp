@@ -0,0 +1,242 @@
+#include "hotband.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+
+
+#define AGING_PERIOD 1000		// number of matches after which all frequencies are halved
+#define HYSTERESIS 2			// frequency difference required to swap a hot and a cold template
+#define TIME_SAMPLES 100		// number of search times for the median, statistics are reported after as many matches
+
+
+HotBand::HotBand(Fingerprint* fp, SensorLibrary* library, int size)
+{
+	this->fp = fp;
+	this->library = library;
+	bandSize = qMax(size, 0);
+	
+	matchCount = 0;
+	hotHits = 0;
+	coldHits = 0;
+	moves = 0;
+	matchTimeIndex = 0;
+}
+
+
+/*
+ * search the feature file in SLOT_1, first in the hot band, then in the remaining occupied slots
+ * additional return parameters:
+ *	* slot of the matching template
+ *	* match score
+ */
+Fingerprint::Status HotBand::search(uint16_t& slot, uint16_t& score)
+{
+	int upper = library->occupancy().upperBound();
+	int hot = qMin(bandSize, upper);
+	
+	QElapsedTimer timer;
+	timer.start();
+	
+	Fingerprint::Status status = Fingerprint::NOTFOUND;
+	bool hotMatch = false;
+	
+	if(hot > 0)
+	{
+		status = fp->search(Fingerprint::SLOT_1, 0, uint16_t(hot), slot, score);
+		hotMatch = (status == Fingerprint::OK);
+	}
+	
+	if(status == Fingerprint::NOTFOUND && upper > hot)
+	{
+		status = fp->search(Fingerprint::SLOT_1, uint16_t(hot), uint16_t(upper - hot), slot, score);
+	}
+	
+	if(status == Fingerprint::OK)
+	{
+		if(hotMatch)
+		{
+			hotHits++;
+		}
+		else
+		{
+			coldHits++;
+		}
+		
+		if(matchTimes.size() < TIME_SAMPLES)
+		{
+			matchTimes.append(timer.elapsed());
+		}
+		else
+		{
+			matchTimes[matchTimeIndex] = timer.elapsed();
+			matchTimeIndex = (matchTimeIndex + 1) % TIME_SAMPLES;
+		}
+		
+		if((hotHits + coldHits) % TIME_SAMPLES == 0)
+		{
+			report();
+		}
+	}
+	
+	return status;
+}
+
+
+/*
+ * template <id> was matched
+ */
+void HotBand::matched(int id)
+{
+	frequency[id]++;
+	
+	// old matches count less
+	if(++matchCount >= AGING_PERIOD)
+	{
+		matchCount = 0;
+		for(int key : frequency.keys())
+		{
+			quint32 halved = frequency.value(key) / 2;
+			if(halved > 0)
+			{
+				frequency.insert(key, halved);
+			}
+			else
+			{
+				frequency.remove(key);
+			}
+		}
+	}
+}
+
+
+/*
+ * find the next move: the most frequent template outside the hot band is moved to a free slot
+ * of the hot band or swapped with the least frequent template of the hot band
+ * return value: true if a move is useful
+ */
+bool HotBand::nextMove(int& from, int& to) const
+{
+	const SlotBitmap& occupied = library->occupancy();
+	
+	// most frequent template outside the hot band
+	from = -1;
+	quint32 coldFrequency = 0;
+	for(int slot = occupied.findNext(bandSize); slot >= 0; slot = occupied.findNext(slot+1))
+	{
+		quint32 f = frequency.value(library->idAt(slot), 0);
+		if(f > coldFrequency)
+		{
+			from = slot;
+			coldFrequency = f;
+		}
+	}
+	if(from < 0)
+	{
+		return false;
+	}
+	
+	to = occupied.findFirstFree();
+	if(to >= 0 && to < bandSize)
+	{
+		return true;
+	}
+	
+	// least frequent template of the hot band
+	to = -1;
+	quint32 hotFrequency = 0;
+	for(int slot = occupied.findNext(0); slot >= 0 && slot < bandSize; slot = occupied.findNext(slot+1))
+	{
+		quint32 f = frequency.value(library->idAt(slot), 0);
+		if(to < 0 || f < hotFrequency)
+		{
+			to = slot;
+			hotFrequency = f;
+		}
+	}
+	
+	return to >= 0 && coldFrequency >= hotFrequency + HYSTERESIS;
+}
+
+
+/*
+ * move the template in slot <from> to slot <to>, the templates are swapped if <to> is occupied
+ * uses both character buffers
+ */
+bool HotBand::move(int from, int to)
+{
+	int fromId = library->idAt(from);
+	QByteArray fromMd5 = library->md5At(from);
+	int toId = library->idAt(to);
+	QByteArray toMd5 = library->md5At(to);
+	
+	Fingerprint::Status status = fp->loadModel(Fingerprint::SLOT_1, uint16_t(from));
+	if(status == Fingerprint::OK && toId >= 0)
+	{
+		status = fp->loadModel(Fingerprint::SLOT_2, uint16_t(to));
+	}
+	if(status != Fingerprint::OK)
+	{
+		fp->printError(status);
+		return false;
+	}
+	
+	// the library is changed after the stores, a failed store leaves the entries of both slots unchanged
+	status = fp->storeModel(Fingerprint::SLOT_1, uint16_t(to));
+	if(status != Fingerprint::OK)
+	{
+		fp->printError(status);
+		return false;
+	}
+	library->assign(to, fromId, fromMd5);		// releases <from>
+	
+	if(toId >= 0)
+	{
+		// swap
+		status = fp->storeModel(Fingerprint::SLOT_2, uint16_t(from));
+		if(status == Fingerprint::OK)
+		{
+			library->assign(from, toId, toMd5);
+		}
+		else
+		{
+			qCritical() << "library: id" << toId << "was overwritten in slot" << to << "and could not be stored in slot" << from
+						<< ", it is missing on the sensor until the next full synchronization";
+		}
+	}
+	else
+	{
+		// a duplicate in a cold slot is never found first, it is deleted afterwards
+		status = fp->deleteModel(uint16_t(from), 1);
+	}
+	library->save();
+	
+	if(status != Fingerprint::OK)
+	{
+		fp->printError(status);
+		return false;
+	}
+	
+	moves++;
+	qDebug() << "library: id" << fromId << "moved from slot" << from << "to" << to << (toId >= 0 ? QString("(swapped with id %1)").arg(toId) : QString());
+	return true;
+}
+
+
+/*
+ * (milliseconds) median search time of the recent matches
+ */
+qint64 HotBand::medianTime() const
+{
+	QVector<qint64> times = matchTimes;
+	std::sort(times.begin(), times.end());
+	return times.isEmpty() ? 0 : times[times.size() / 2];
+}
+
+
+void HotBand::report() const
+{
+	int hits = hotHits + coldHits;
+	qDebug() << "hot band:" << bandSize << "slots," << (hits > 0 ? hotHits * 100 / hits : 0) << "% of" << hits
+			 << "matches in hot band, median search time" << medianTime() << "ms," << moves << "moves";
+}
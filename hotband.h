@@ -0,0 +1,50 @@
+#ifndef HOTBAND_H
+#define HOTBAND_H
+
+#include <QHash>
+#include <QVector>
+
+#include "fingerprint.h"
+#include "sensorlibrary.h"
+
+/*
+ * two-phase search with the frequently matched templates in a band of low slots
+ * 
+ * The hot band (slots 0 ... size-1) is searched first, the rest of the library only if the hot band
+ * has no match. Matches are counted per ID, templates are moved between the bands on the sensor
+ * (loadModel/storeModel), the templates are not transferred over the serial link.
+ */
+class HotBand
+{
+public:
+	HotBand(Fingerprint* fp, SensorLibrary* library, int size);
+	
+	int size() const { return bandSize; }
+	
+	Fingerprint::Status search(uint16_t& slot, uint16_t& score);
+	void matched(int id);
+	void forget(int id) { frequency.remove(id); }
+	
+	bool nextMove(int& from, int& to) const;
+	bool move(int from, int to);
+	
+	qint64 medianTime() const;
+	void report() const;
+	
+private:
+	Fingerprint* fp;
+	SensorLibrary* library;
+	int bandSize;						// number of slots in the hot band
+	
+	QHash<int, quint32> frequency;		// ID -> number of matches (aged)
+	quint32 matchCount;					// matches since the last aging
+	
+	// statistics
+	int hotHits;
+	int coldHits;
+	int moves;
+	QVector<qint64> matchTimes;			// (milliseconds) search time of the recent matches
+	int matchTimeIndex;
+};
+
+#endif // HOTBAND_H
@@ -0,0 +1,235 @@
+#include "packetframer.h"
+
+#include <string.h>
+
+
+// packet format
+//  0      1      2     3     4     5     6     7    8
+// {START, START, ADDR, ADDR, ADDR, ADDR, TYPE, LEN, LEN, DATA..., SUM, SUM}
+
+#define STARTCODE_H 0xEF				// packet start code
+#define STARTCODE_L 0x01
+#define HEADERSIZE 9
+
+
+PacketFramer::PacketFramer()
+{
+	dropped=0;
+	clear();
+}
+
+
+void PacketFramer::clear()
+{
+	head=0;
+	tail=0;
+	state=SYNC;
+	pos=0;
+	len=0;
+	sum=0;
+}
+
+
+/*
+ * contiguous free space at the write index
+ */
+char* PacketFramer::writePointer(int& size)
+{
+	uint32_t index=tail & (CAPACITY-1);
+	uint32_t space=CAPACITY-(tail-head);
+	
+	size=int(space < CAPACITY-index ? space : CAPACITY-index);
+	return ring+index;
+}
+
+
+void PacketFramer::commit(int count)
+{
+	tail+=uint32_t(count);
+}
+
+
+/*
+ * copy data into the ring buffer
+ * return value: number of bytes accepted
+ */
+int PacketFramer::write(const char* data, int size)
+{
+	int written=0;
+	
+	while(written<size)
+	{
+		int space;
+		char* p=writePointer(space);
+		if(space==0)
+		{
+			break;		// full
+		}
+		
+		int n=(size-written < space) ? size-written : space;
+		memcpy(p, data+written, size_t(n));
+		commit(n);
+		written+=n;
+	}
+	
+	return written;
+}
+
+
+int PacketFramer::size() const
+{
+	return int(tail-head);
+}
+
+
+/*
+ * parse the next packet
+ * type, data (return parameters): type and content (without checksum) of the packet
+ * return value: PACKET if a valid packet was received, BAD_CHECKSUM if a packet with wrong checksum was received (it is dropped),
+ *  NEED_MORE if there is no complete packet in the buffer
+ */
+PacketFramer::Result PacketFramer::next(uint8_t& type, QByteArray& data)
+{
+	while(true)
+	{
+		uint32_t available=tail-head;
+		
+		switch(state)
+		{
+			case SYNC:
+			{
+				if(!sync())
+				{
+					return NEED_MORE;
+				}
+				state=HEADER;
+				break;
+			}
+				
+			case HEADER:
+			{
+				if(available<HEADERSIZE)
+				{
+					return NEED_MORE;
+				}
+				
+				len=uint16_t((at(7)<<8) | at(8));
+				
+				if(!isValidType(at(6)) || len<2 || len>MAX_PACKET_LEN)
+				{
+					// not a packet header, search for the next start code
+					skip(1);
+					dropped++;
+					state=SYNC;
+					break;
+				}
+				
+				sum=uint16_t(at(6)+at(7)+at(8));
+				pos=HEADERSIZE;
+				state=PAYLOAD;
+				break;
+			}
+				
+			case PAYLOAD:
+			{
+				uint32_t dataEnd=HEADERSIZE+len-2u;
+				
+				// checksum new bytes only
+				while(pos<dataEnd && pos<available)
+				{
+					sum=uint16_t(sum+at(pos));
+					pos++;
+				}
+				
+				if(available<dataEnd+2)
+				{
+					return NEED_MORE;
+				}
+				
+				uint16_t checksum=uint16_t((at(dataEnd)<<8) | at(dataEnd+1));
+				
+				// copy data out of the ring buffer (may wrap around)
+				uint32_t start=(head+HEADERSIZE) & (CAPACITY-1);
+				uint32_t n=len-2u;
+				uint32_t first=(n < CAPACITY-start) ? n : CAPACITY-start;
+				data.resize(int(n));
+				memcpy(data.data(), ring+start, first);
+				memcpy(data.data()+first, ring, n-first);
+				
+				type=at(6);
+				
+				skip(dataEnd+2);
+				state=SYNC;
+				
+				return (sum==checksum) ? PACKET : BAD_CHECKSUM;
+			}
+		}
+	}
+}
+
+
+/************************************************************/
+/*					private functions:						*/
+/************************************************************/
+
+void PacketFramer::skip(uint32_t count)
+{
+	head+=count;
+	pos=0;
+}
+
+
+/*
+ * drop bytes until head points to a start code
+ * return value: false if more data is needed
+ */
+bool PacketFramer::sync()
+{
+	while(head!=tail)
+	{
+		// scan the contiguous part of the buffer for the first start code byte
+		uint32_t index=head & (CAPACITY-1);
+		uint32_t n=tail-head;
+		if(n>CAPACITY-index)
+		{
+			n=CAPACITY-index;
+		}
+		
+		const char* p=(const char*)memchr(ring+index, STARTCODE_H, n);
+		if(p==nullptr)
+		{
+			dropped+=n;
+			skip(n);
+			continue;
+		}
+		
+		uint32_t offset=uint32_t(p-(ring+index));
+		dropped+=offset;
+		skip(offset);
+		
+		if(tail-head<2)
+		{
+			return false;	// wait for second byte
+		}
+		
+		if(at(1)==STARTCODE_L)
+		{
+			return true;
+		}
+		
+		// false start code candidate
+		dropped++;
+		skip(1);
+	}
+	
+	return false;
+}
+
+
+/*
+ * packet types COMMAND, DATA, ACK and END (see Fingerprint::PacketType)
+ */
+bool PacketFramer::isValidType(uint8_t type)
+{
+	return type==0x01 || type==0x02 || type==0x07 || type==0x08;
+}
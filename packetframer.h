@@ -0,0 +1,63 @@
+#ifndef PACKETFRAMER_H
+#define PACKETFRAMER_H
+
+/*
+ * receive side of the ZFM-20 serial protocol
+ * 
+ * Received bytes are stored in a fixed size ring buffer. Packets are parsed incrementally:
+ * partial packets and following bytes are kept between calls, every byte is checksummed once
+ * and after noise the parser jumps to the next start code candidate in a single scan.
+ */
+
+#include <stdint.h>
+
+#include <QByteArray>
+
+
+class PacketFramer
+{
+public:
+	
+	enum Result {NEED_MORE=0, PACKET=1, BAD_CHECKSUM=2};
+	
+	static const int CAPACITY=1024;				// ring buffer size, has to be a power of 2
+	static const int MAX_PACKET_LEN=256+2;		// max. value of the length field (data + checksum)
+	
+	PacketFramer();
+	
+	void clear();
+	
+	// direct access for reading from the serial port
+	char* writePointer(int& size);		// size (return parameter): contiguous free space
+	void commit(int count);				// count bytes were written to writePointer()
+	
+	int write(const char* data, int size);
+	int size() const;
+	
+	Result next(uint8_t& type, QByteArray& data);
+	
+	uint32_t droppedBytes() const { return dropped; }
+	
+private:
+	
+	enum State {SYNC, HEADER, PAYLOAD};
+	
+	uint8_t at(uint32_t offset) const { return (uint8_t)ring[(head+offset) & (CAPACITY-1)]; }
+	void skip(uint32_t count);
+	bool sync();
+	static bool isValidType(uint8_t type);
+	
+	char ring[CAPACITY];
+	uint32_t head;		// read index (free running)
+	uint32_t tail;		// write index (free running)
+	
+	// parser state of the packet at head
+	State state;
+	uint32_t pos;		// number of bytes of the packet already parsed
+	uint16_t len;		// value of the length field
+	uint16_t sum;		// checksum of the parsed bytes
+	
+	uint32_t dropped;	// number of bytes dropped while searching for a start code
+};
+
+#endif // PACKETFRAMER_H
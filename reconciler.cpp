@@ -0,0 +1,309 @@
+#include "reconciler.h"
+#include "templateloader.h"
+
+#include <QDebug>
+#include <QCryptographicHash>
+#include <algorithm>
+
+
+Reconciler::Reconciler(Fingerprint* fp, SensorLibrary* library, bool cache, TemplateSnapshot* snapshot)
+{
+	this->fp = fp;
+	this->library = library;
+	this->cache = cache;
+	this->snapshot = snapshot;
+	
+	unknown.resize(library->capacity());
+	orphans.resize(library->capacity());
+}
+
+
+/*
+ * compare the library assignment with the occupancy of the sensor library
+ * slots that are not occupied are released, occupied slots that are not assigned become orphans
+ */
+bool Reconciler::readSensor()
+{
+	SlotBitmap sensor(library->capacity());
+	Fingerprint::Status status = fp->readIndex(sensor);
+	if(status != Fingerprint::OK)
+	{
+		fp->printError(status);
+		return false;
+	}
+	
+	for(int slot : (library->occupancy() - sensor).toList())
+	{
+		qWarning() << "reconcile: slot" << slot << "is empty, template" << library->idAt(slot) << "lost";
+		library->release(slot);
+	}
+	
+	unknown = sensor - library->occupancy();
+	return true;
+}
+
+
+void Reconciler::compare(const QHash<int, QByteArray>& dbHashes)
+{
+	orphans = unknown;
+	stale.clear();
+	missing.clear();
+	expected.clear();
+	
+	for(int slot : library->occupancy().toList())
+	{
+		check(library->idAt(slot), dbHashes);
+	}
+	
+	for(int id : dbHashes.keys())
+	{
+		if(!library->contains(id))
+		{
+			missing.append(id);
+			expected.insert(id, dbHashes.value(id));
+		}
+	}
+	
+	std::sort(missing.begin(), missing.end());
+	limitMissing();
+	report();
+}
+
+
+void Reconciler::compare(const QHash<int, QByteArray>& dbHashes, const QSet<int>& changedIds)
+{
+	orphans = unknown;
+	stale.clear();
+	missing.clear();
+	expected.clear();
+	
+	for(int id : changedIds)
+	{
+		if(library->contains(id))
+		{
+			check(id, dbHashes);
+		}
+		else if(dbHashes.contains(id))
+		{
+			missing.append(id);
+			expected.insert(id, dbHashes.value(id));
+		}
+	}
+	
+	std::sort(missing.begin(), missing.end());
+	limitMissing();
+	report();
+}
+
+
+/*
+ * delete orphans from the sensor, consecutive slots are deleted with a single command
+ * return value: number of deleted templates
+ */
+int Reconciler::removeOrphans()
+{
+	int deleted = 0;
+	
+	for(const QPair<int, int>& range : orphans.ranges())
+	{
+		Fingerprint::Status status = fp->deleteModel(uint16_t(range.first), uint16_t(range.second));
+		if(status == Fingerprint::OK)
+		{
+			for(int slot = range.first; slot < range.first + range.second; slot++)
+			{
+				library->release(slot);
+				unknown.remove(slot);
+				orphans.remove(slot);
+			}
+			deleted += range.second;
+		}
+		else
+		{
+			fp->printError(status);
+		}
+	}
+	
+	if(deleted > 0)
+	{
+		library->save();
+	}
+	return deleted;
+}
+
+
+/*
+ * store missing and stale templates on the sensor, the templates are read from the snapshot
+ * stale templates are replaced in their slot, missing templates are stored in free slots
+ * templates that are not in the snapshot with the current hash are listed by unavailable(),
+ * they have to be copied from the database first
+ * at most <limit> templates (0: all) are stored, the rest stays missing or stale for the next call
+ * return value: number of stored templates
+ */
+int Reconciler::loadMissing(int limit)
+{
+	unavailableIds.clear();
+	
+	QHash<int, int> targets;		// ID -> slot
+	SlotBitmap reserved = library->occupancy();
+	reserved.unite(orphans);
+	
+	bool released = false;
+	for(int slot : stale)
+	{
+		if(limit > 0 && targets.size() >= limit)
+		{
+			break;
+		}
+		
+		int id = library->idAt(slot);
+		if(!isAvailable(id))
+		{
+			unavailableIds.append(id);
+			continue;
+		}
+		targets.insert(id, slot);
+		library->release(slot);
+		released = true;
+	}
+	
+	int placed = 0;
+	for(int id : missing)
+	{
+		if(limit > 0 && targets.size() >= limit)
+		{
+			break;
+		}
+		if(!isAvailable(id))
+		{
+			unavailableIds.append(id);
+			continue;
+		}
+		
+		int slot = reserved.findFirstFree();
+		if(slot < 0)
+		{
+			qCritical() << "reconcile: sensor library is full," << missing.size() - placed << "templates can not be stored";
+			break;
+		}
+		reserved.insert(slot);
+		targets.insert(id, slot);
+		placed++;
+	}
+	
+	if(!unavailableIds.isEmpty())
+	{
+		qDebug() << "reconcile:" << unavailableIds.size() << "templates not in the snapshot yet";
+	}
+	if(targets.isEmpty())
+	{
+		return 0;
+	}
+	
+	// the slots to overwrite are released before the transfer, a crash leaves them unassigned
+	if(released)
+	{
+		library->save();
+	}
+	
+	TemplateLoader loader(fp);
+	QList<int> ids = targets.keys();
+	int next = 0;
+	int loaded = loader.load([this, &ids, &next](int& id, QByteArray& fpTemplate)
+	{
+		if(next >= ids.size())
+		{
+			return false;
+		}
+		id = ids[next++];
+		fpTemplate = snapshot->fpTemplate(id);
+		return true;
+	}, targets, [this](int id, int slot, const QByteArray& fpTemplate)
+	{
+		library->assign(slot, id, QCryptographicHash::hash(fpTemplate, QCryptographicHash::Md5).toHex());
+	});
+	library->save();
+	
+	// templates that were not stored
+	QList<int> remaining;
+	for(int id : missing)
+	{
+		if(!library->contains(id))
+		{
+			remaining.append(id);
+		}
+	}
+	missing = remaining;
+	
+	remaining.clear();
+	for(int slot : stale)
+	{
+		if(!library->occupancy().contains(slot) || library->md5At(slot) != expected.value(library->idAt(slot)))
+		{
+			remaining.append(slot);
+		}
+	}
+	stale = remaining;
+	
+	return loaded;
+}
+
+
+/*
+ * the current template of <id> can be read from the snapshot
+ */
+bool Reconciler::isAvailable(int id) const
+{
+	return snapshot && snapshot->contains(id) && snapshot->md5(id) == expected.value(id);
+}
+
+
+bool Reconciler::isInSync() const
+{
+	return missing.isEmpty() && stale.isEmpty() && orphans.isEmpty();
+}
+
+
+/*
+ * compare the assigned template <id> with the database
+ */
+void Reconciler::check(int id, const QHash<int, QByteArray>& dbHashes)
+{
+	int slot = library->slotOf(id);
+	
+	if(!dbHashes.contains(id))
+	{
+		orphans.insert(slot);
+	}
+	else if(dbHashes.value(id) != library->md5At(slot))
+	{
+		stale.append(slot);
+		expected.insert(id, dbHashes.value(id));
+	}
+}
+
+
+/*
+ * in cache mode only the missing templates that fit into the free slots are loaded
+ */
+void Reconciler::limitMissing()
+{
+	if(!cache)
+	{
+		return;
+	}
+	
+	// free slots after the orphans were deleted
+	int free = library->capacity() - library->count() - unknown.count() + orphans.count();
+	if(missing.size() > free)
+	{
+		qDebug() << "reconcile:" << missing.size() - qMax(free, 0) << "templates not cached, library is full";
+		missing = missing.mid(0, qMax(free, 0));
+	}
+}
+
+
+void Reconciler::report() const
+{
+	qDebug() << "reconcile:" << library->count() << "on sensor," << missing.size() << "missing,"
+			 << stale.size() << "stale," << orphans.count() << "orphans";
+}
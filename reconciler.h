@@ -0,0 +1,61 @@
+#ifndef RECONCILER_H
+#define RECONCILER_H
+
+#include <QList>
+#include <QHash>
+#include <QSet>
+
+#include "fingerprint.h"
+#include "sensorlibrary.h"
+#include "slotbitmap.h"
+#include "snapshot.h"
+
+/*
+ * brings the sensor library in sync with the database
+ * 
+ * The library assignment (slot -> database ID, template hash) is compared with the template hashes
+ * in the database. Only the difference is transferred: missing and stale templates are downloaded,
+ * orphans are deleted with ranged deletes.
+ * In cache mode the sensor holds a subset of the database, missing templates are only loaded
+ * into free slots.
+ * The templates are read from the snapshot, templates that are not in the snapshot with the current
+ * hash are reported by unavailable() and loaded by the next reconcile once they were copied.
+ */
+class Reconciler
+{
+public:
+	Reconciler(Fingerprint* fp, SensorLibrary* library, bool cache, TemplateSnapshot* snapshot);
+	
+	bool readSensor();
+	
+	// dbHashes: template hashes of all IDs in the database
+	void compare(const QHash<int, QByteArray>& dbHashes);
+	// dbHashes: template hashes of the changed IDs that are still in the database
+	void compare(const QHash<int, QByteArray>& dbHashes, const QSet<int>& changedIds);
+	
+	int removeOrphans();
+	int loadMissing(int limit = 0);
+	const QList<int>& unavailable() const { return unavailableIds; }
+	
+	bool isInSync() const;
+	
+private:
+	void check(int id, const QHash<int, QByteArray>& dbHashes);
+	bool isAvailable(int id) const;
+	void limitMissing();
+	void report() const;
+	
+	Fingerprint* fp;
+	SensorLibrary* library;
+	bool cache;				// sensor library is a cache of the database
+	TemplateSnapshot* snapshot;
+	
+	SlotBitmap unknown;		// occupied slots with unknown content
+	SlotBitmap orphans;		// slots to delete
+	QList<int> stale;		// slots with a template that changed in the database
+	QList<int> missing;		// IDs in database, not on sensor
+	QHash<int, QByteArray> expected;	// template hashes of the stale and missing IDs
+	QList<int> unavailableIds;			// stale and missing IDs that are not in the snapshot
+};
+
+#endif // RECONCILER_H
@@ -0,0 +1,62 @@
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include <QVector>
+
+#include <utility>
+
+/*
+ * FIFO queue for a single thread in a ring buffer that is reused
+ *
+ * The buffer only grows (doubling) when the queue is full, once the queue has reached its working size
+ * enqueue() and dequeue() do not allocate. Items are moved in and out, T has to be default constructible.
+ */
+template <typename T>
+class RingQueue
+{
+public:
+	explicit RingQueue(int capacity = 8) : items(qMax(capacity, 1)), first(0), count(0) {}
+
+	bool isEmpty() const { return count == 0; }
+	int size() const { return count; }
+
+	T& head() { return items[first]; }
+	T& last() { return items[(first + count - 1) % items.size()]; }
+
+	void enqueue(T&& item)
+	{
+		if(count == items.size())
+		{
+			grow();
+		}
+		items[(first + count) % items.size()] = std::move(item);
+		count++;
+	}
+
+	T dequeue()
+	{
+		T item = std::move(items[first]);
+		items[first] = T();
+		first = (first + 1) % items.size();
+		count--;
+		return item;
+	}
+
+private:
+	void grow()
+	{
+		QVector<T> larger(items.size() * 2);
+		for(int i = 0; i < count; i++)
+		{
+			larger[i] = std::move(items[(first + i) % items.size()]);
+		}
+		items.swap(larger);
+		first = 0;
+	}
+
+	QVector<T> items;
+	int first;		// index of the head
+	int count;		// number of items
+};
+
+#endif // RINGQUEUE_H
@@ -0,0 +1,94 @@
+#include "scangovernor.h"
+
+#include <QDebug>
+#include <QStringList>
+
+
+#define FIRST_BACKOFF 25		// (milliseconds) first interval above the full rate
+
+
+/*
+ * windows: comma separated list of time windows "hh:mm-hh:mm", a window may span midnight
+ */
+ScanGovernor::ScanGovernor(int minInterval, int maxInterval, int idleTime, const QString& windows)
+{
+	this->minInterval = qMax(minInterval, 0);
+	this->maxInterval = qMax(maxInterval, this->minInterval);
+	this->idleTime = idleTime;
+	current = this->minInterval;
+	lastActivity.start();
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	QStringList list = windows.split(',', Qt::SkipEmptyParts);
+#else
+	QStringList list = windows.split(',', QString::SkipEmptyParts);
+#endif
+	for(const QString& window : list)
+	{
+		QTime start = QTime::fromString(window.section('-', 0, 0).trimmed(), "hh:mm");
+		QTime end = QTime::fromString(window.section('-', 1, 1).trimmed(), "hh:mm");
+		if(!start.isValid() || !end.isValid())
+		{
+			qWarning() << "FULL_RATE_WINDOWS: invalid time window" << window;
+			continue;
+		}
+		this->windows.append(qMakePair(start, end));
+	}
+}
+
+
+void ScanGovernor::detected()
+{
+	activity();
+}
+
+
+void ScanGovernor::activity()
+{
+	lastActivity.restart();
+	if(current > minInterval)
+	{
+		qDebug() << "scan rate: full rate";
+		current = minInterval;
+	}
+}
+
+
+/*
+ * called before every scan without finger
+ */
+int ScanGovernor::interval()
+{
+	if(lastActivity.elapsed() < idleTime || inWindow())
+	{
+		current = minInterval;
+		return current;
+	}
+
+	if(current < maxInterval)
+	{
+		current = qMin(qMax(current*2, FIRST_BACKOFF), maxInterval);
+		if(current == maxInterval)
+		{
+			qDebug() << "scan rate: idle, every" << maxInterval << "ms";
+		}
+	}
+	return current;
+}
+
+
+bool ScanGovernor::inWindow() const
+{
+	QTime now = QTime::currentTime();
+
+	for(const QPair<QTime, QTime>& window : windows)
+	{
+		bool inside = (window.first <= window.second) ? (window.first <= now && now < window.second)
+													  : (window.first <= now || now < window.second);
+		if(inside)
+		{
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,38 @@
+#ifndef SCANGOVERNOR_H
+#define SCANGOVERNOR_H
+
+#include <QString>
+#include <QList>
+#include <QPair>
+#include <QTime>
+#include <QElapsedTimer>
+
+/*
+ * scan rate of the sensor without touch events
+ *
+ * The sensor is scanned at the full rate (minimum interval) after a finger was detected, a command was
+ * received or during the configured time windows. After <idleTime> without activity the interval between
+ * two scans is doubled with every empty scan up to the maximum interval, which bounds the detection latency.
+ */
+class ScanGovernor
+{
+public:
+	ScanGovernor(int minInterval, int maxInterval, int idleTime, const QString& windows);
+
+	void detected();		// a finger was detected
+	void activity();		// a command was received
+	int interval();			// (milliseconds) pause before the next scan
+
+private:
+	bool inWindow() const;
+
+	int minInterval;		// (milliseconds)
+	int maxInterval;		// (milliseconds)
+	int idleTime;			// (milliseconds) time at the full rate after activity
+	QList<QPair<QTime, QTime>> windows;		// time windows with the full rate
+
+	QElapsedTimer lastActivity;
+	int current;			// (milliseconds) current interval
+};
+
+#endif // SCANGOVERNOR_H
@@ -0,0 +1,172 @@
+#include "sensorlibrary.h"
+#include "defs.h"
+
+#include <QDebug>
+#include <QSettings>
+#include <QStringList>
+#include <QCryptographicHash>
+
+
+SensorLibrary::SensorLibrary(int capacity)
+{
+	resize(capacity);
+}
+
+
+/*
+ * change capacity, slots above the new capacity are released
+ */
+void SensorLibrary::resize(int capacity)
+{
+	for(int slot = occupied.findNext(capacity); slot >= 0; slot = occupied.findNext(slot+1))
+	{
+		release(slot);
+	}
+	
+	occupied.resize(capacity);
+	idBySlot.resize(capacity);
+	md5BySlot.resize(capacity);
+}
+
+
+/*
+ * database ID of the template in <slot>, -1 if the slot is empty
+ */
+int SensorLibrary::idAt(int slot) const
+{
+	return occupied.contains(slot) ? idBySlot[slot] : -1;
+}
+
+
+QByteArray SensorLibrary::md5At(int slot) const
+{
+	return occupied.contains(slot) ? md5BySlot[slot] : QByteArray();
+}
+
+
+/*
+ * the template <id> was stored in <slot>
+ */
+void SensorLibrary::assign(int slot, int id, const QByteArray& md5)
+{
+	if(slot < 0 || slot >= capacity())
+	{
+		qWarning() << "library: invalid slot" << slot;
+		return;
+	}
+	
+	release(slot);
+	
+	// a template is stored only once
+	int previous = slotOf(id);
+	if(previous >= 0)
+	{
+		release(previous);
+	}
+	
+	occupied.insert(slot);
+	idBySlot[slot] = id;
+	md5BySlot[slot] = md5;
+	slotById.insert(id, slot);
+}
+
+
+/*
+ * <slot> was deleted or is about to be overwritten
+ */
+void SensorLibrary::release(int slot)
+{
+	if(!occupied.contains(slot))
+	{
+		return;
+	}
+	
+	slotById.remove(idBySlot[slot]);
+	md5BySlot[slot].clear();
+	occupied.remove(slot);
+}
+
+
+void SensorLibrary::clear()
+{
+	occupied.clear();
+	slotById.clear();
+	for(int slot = 0; slot < capacity(); slot++)
+	{
+		md5BySlot[slot].clear();
+	}
+}
+
+
+/*
+ * read the assignment from the state file
+ */
+void SensorLibrary::load()
+{
+	clear();
+	
+	QSettings state(STATE_FILE, QSettings::IniFormat);
+	if(state.childGroups().contains("library"))
+	{
+		// key: slot, value: ID:MD5
+		state.beginGroup("library");
+		for(const QString& key : state.childKeys())
+		{
+			QStringList entry = state.value(key).toString().split(':');
+			if(entry.size() == 2)
+			{
+				assign(key.toInt(), entry[0].toInt(), entry[1].toLatin1());
+			}
+		}
+	}
+	else
+	{
+		// template records of previous versions, the slot is the database ID
+		state.beginGroup("templates");
+		for(const QString& key : state.childKeys())
+		{
+			assign(key.toInt(), key.toInt(), state.value(key).toByteArray());
+		}
+	}
+	
+	qDebug() << "library:" << count() << "templates known on sensor";
+}
+
+
+/*
+ * write the assignment to the state file
+ */
+void SensorLibrary::save()
+{
+	QSettings state(STATE_FILE, QSettings::IniFormat);
+	state.remove("templates");
+	state.remove("library");
+	
+	state.beginGroup("library");
+	for(int slot : occupied.toList())
+	{
+		state.setValue(QString::number(slot), QString("%1:%2").arg(idBySlot[slot]).arg(QString::fromLatin1(md5BySlot[slot])));
+	}
+	state.endGroup();
+	
+	state.sync();
+	if(state.status() != QSettings::NoError)
+	{
+		qCritical() << "library: failed to write" << STATE_FILE;
+	}
+}
+
+
+/*
+ * hash of the complete assignment
+ */
+QByteArray SensorLibrary::digest() const
+{
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	for(int slot : occupied.toList())
+	{
+		hash.addData(QByteArray::number(slot).append(':').append(QByteArray::number(idBySlot[slot])).append(':'));
+		hash.addData(QByteArray(md5BySlot[slot]).append(';'));
+	}
+	return hash.result();
+}
@@ -0,0 +1,49 @@
+#ifndef SENSORLIBRARY_H
+#define SENSORLIBRARY_H
+
+#include <QVector>
+#include <QHash>
+#include <QList>
+#include <QByteArray>
+
+#include "slotbitmap.h"
+
+/*
+ * content of the sensor library: database ID and template hash (MD5, hex) of every occupied slot
+ * 
+ * Slots of the sensor library and database IDs are independent, search results are translated with
+ * idAt(). The assignment is kept in the state file, save() writes all changes at once.
+ */
+class SensorLibrary
+{
+public:
+	explicit SensorLibrary(int capacity = 0);
+	
+	void resize(int capacity);
+	int capacity() const { return occupied.capacity(); }
+	
+	const SlotBitmap& occupancy() const { return occupied; }
+	int count() const { return occupied.count(); }
+	
+	int idAt(int slot) const;
+	int slotOf(int id) const { return slotById.value(id, -1); }
+	QByteArray md5At(int slot) const;
+	bool contains(int id) const { return slotById.contains(id); }
+	QList<int> ids() const { return slotById.keys(); }
+	
+	void assign(int slot, int id, const QByteArray& md5);
+	void release(int slot);
+	void clear();
+	
+	void load();
+	void save();
+	QByteArray digest() const;
+	
+private:
+	SlotBitmap occupied;
+	QVector<int> idBySlot;
+	QVector<QByteArray> md5BySlot;
+	QHash<int, int> slotById;
+};
+
+#endif // SENSORLIBRARY_H
@@ -0,0 +1,280 @@
+#include "slotbitmap.h"
+
+#include <QtAlgorithms>
+
+
+SlotBitmap::SlotBitmap(int capacity)
+{
+	resize(capacity);
+}
+
+
+/*
+ * change capacity, IDs above the new capacity are removed
+ */
+void SlotBitmap::resize(int capacity)
+{
+	size = capacity > 0 ? capacity : 0;
+	words.resize((size + 63) / 64);
+	clearTail();
+}
+
+
+bool SlotBitmap::contains(int id) const
+{
+	if(id < 0 || id >= size)
+	{
+		return false;
+	}
+	return (words[id / 64] >> (id % 64)) & 1;
+}
+
+
+/*
+ * return value: false if id is outside the capacity
+ */
+bool SlotBitmap::insert(int id)
+{
+	if(id < 0 || id >= size)
+	{
+		return false;
+	}
+	words[id / 64] |= quint64(1) << (id % 64);
+	return true;
+}
+
+
+void SlotBitmap::remove(int id)
+{
+	if(id >= 0 && id < size)
+	{
+		words[id / 64] &= ~(quint64(1) << (id % 64));
+	}
+}
+
+
+void SlotBitmap::clear()
+{
+	words.fill(0);
+}
+
+
+/*
+ * number of occupied IDs
+ */
+int SlotBitmap::count() const
+{
+	int n = 0;
+	for(quint64 word : words)
+	{
+		n += int(qPopulationCount(word));
+	}
+	return n;
+}
+
+
+bool SlotBitmap::isEmpty() const
+{
+	for(quint64 word : words)
+	{
+		if(word != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/*
+ * lowest free ID >= from
+ * return value: -1 if there is no free ID
+ */
+int SlotBitmap::findFirstFree(int from) const
+{
+	if(from < 0)
+	{
+		from = 0;
+	}
+	
+	for(int i = from / 64; i < words.size(); i++)
+	{
+		quint64 free = ~words[i];
+		if(i == from / 64)
+		{
+			free &= ~quint64(0) << (from % 64);
+		}
+		
+		if(free != 0)
+		{
+			int id = i*64 + int(qCountTrailingZeroBits(free));
+			return id < size ? id : -1;
+		}
+	}
+	return -1;
+}
+
+
+/*
+ * lowest occupied ID >= from
+ * return value: -1 if there is none
+ */
+int SlotBitmap::findNext(int from) const
+{
+	if(from < 0)
+	{
+		from = 0;
+	}
+	
+	for(int i = from / 64; i < words.size(); i++)
+	{
+		quint64 used = words[i];
+		if(i == from / 64)
+		{
+			used &= ~quint64(0) << (from % 64);
+		}
+		
+		if(used != 0)
+		{
+			return i*64 + int(qCountTrailingZeroBits(used));
+		}
+	}
+	return -1;
+}
+
+
+/*
+ * highest occupied ID + 1, 0 if empty
+ * the IDs 0 ... upperBound()-1 cover all occupied IDs (e.g. for a search)
+ */
+int SlotBitmap::upperBound() const
+{
+	for(int i = words.size()-1; i >= 0; i--)
+	{
+		if(words[i] != 0)
+		{
+			return i*64 + 64 - int(qCountLeadingZeroBits(words[i]));
+		}
+	}
+	return 0;
+}
+
+
+SlotBitmap& SlotBitmap::subtract(const SlotBitmap& other)
+{
+	int n = qMin(words.size(), other.words.size());
+	for(int i = 0; i < n; i++)
+	{
+		words[i] &= ~other.words[i];
+	}
+	return *this;
+}
+
+
+/*
+ * IDs of <other> outside the capacity are ignored
+ */
+SlotBitmap& SlotBitmap::unite(const SlotBitmap& other)
+{
+	int n = qMin(words.size(), other.words.size());
+	for(int i = 0; i < n; i++)
+	{
+		words[i] |= other.words[i];
+	}
+	clearTail();
+	return *this;
+}
+
+
+SlotBitmap& SlotBitmap::intersect(const SlotBitmap& other)
+{
+	for(int i = 0; i < words.size(); i++)
+	{
+		words[i] &= (i < other.words.size()) ? other.words[i] : 0;
+	}
+	return *this;
+}
+
+
+/*
+ * compares the occupied IDs, regardless of capacity
+ */
+bool SlotBitmap::operator==(const SlotBitmap& other) const
+{
+	int n = qMax(words.size(), other.words.size());
+	for(int i = 0; i < n; i++)
+	{
+		quint64 a = (i < words.size()) ? words[i] : 0;
+		quint64 b = (i < other.words.size()) ? other.words[i] : 0;
+		if(a != b)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/*
+ * add the IDs of a bitmap in bytes (bit 0 of byte 0 is ID <first>), first has to be a multiple of 8
+ */
+void SlotBitmap::insertBytes(int first, const QByteArray& bytes)
+{
+	for(int i = 0; i < bytes.size(); i++)
+	{
+		int id = first + i*8;
+		if(id < 0 || id >= size)
+		{
+			continue;
+		}
+		words[id / 64] |= quint64(uchar(bytes[i])) << (id % 64);
+	}
+	clearTail();
+}
+
+
+/*
+ * occupied IDs in ascending order
+ */
+QList<int> SlotBitmap::toList() const
+{
+	QList<int> ids;
+	for(int id = findNext(0); id >= 0; id = findNext(id+1))
+	{
+		ids.append(id);
+	}
+	return ids;
+}
+
+
+/*
+ * runs of consecutive occupied IDs in ascending order
+ * return value: list of (first ID, count)
+ */
+QList<QPair<int, int>> SlotBitmap::ranges() const
+{
+	QList<QPair<int, int>> runs;
+	for(int first = findNext(0); first >= 0; )
+	{
+		int end = findFirstFree(first);
+		if(end < 0)
+		{
+			end = size;
+		}
+		runs.append(qMakePair(first, end - first));
+		first = findNext(end);
+	}
+	return runs;
+}
+
+
+/*
+ * clear the unused bits of the last word
+ */
+void SlotBitmap::clearTail()
+{
+	if(size % 64 != 0)
+	{
+		words[size / 64] &= (quint64(1) << (size % 64)) - 1;
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef SLOTBITMAP_H
+#define SLOTBITMAP_H
+
+#include <QVector>
+#include <QList>
+#include <QByteArray>
+#include <QPair>
+
+/*
+ * occupancy bitmap of the fingerprint library, one bit per ID
+ * 
+ * The IDs 0 ... capacity-1 are stored in 64 bit words, searches and set operations work on
+ * whole words. IDs outside the capacity are never contained.
+ */
+class SlotBitmap
+{
+public:
+	explicit SlotBitmap(int capacity = 0);
+	
+	void resize(int capacity);
+	int capacity() const { return size; }
+	
+	bool contains(int id) const;
+	bool insert(int id);
+	void remove(int id);
+	void clear();
+	
+	int count() const;
+	bool isEmpty() const;
+	
+	int findFirstFree(int from = 0) const;
+	int findNext(int from) const;
+	int upperBound() const;
+	
+	SlotBitmap& subtract(const SlotBitmap& other);
+	SlotBitmap& unite(const SlotBitmap& other);
+	SlotBitmap& intersect(const SlotBitmap& other);
+	SlotBitmap operator-(const SlotBitmap& other) const { return SlotBitmap(*this).subtract(other); }
+	SlotBitmap operator&(const SlotBitmap& other) const { return SlotBitmap(*this).intersect(other); }
+	
+	bool operator==(const SlotBitmap& other) const;
+	bool operator!=(const SlotBitmap& other) const { return !(*this == other); }
+	
+	void insertBytes(int first, const QByteArray& bytes);
+	QList<int> toList() const;
+	QList<QPair<int, int>> ranges() const;
+	
+private:
+	void clearTail();
+	
+	int size;					// capacity in bits
+	QVector<quint64> words;
+};
+
+#endif // SLOTBITMAP_H
@@ -0,0 +1,281 @@
+#include "snapshot.h"
+#include "defs.h"
+
+#include <QDebug>
+#include <QCryptographicHash>
+#include <cstring>
+
+
+#define SNAPSHOT_MAGIC "FPSNAP"
+#define SNAPSHOT_VERSION 1
+#define TEMPLATE_SIZE 512		// size of a template file in bytes
+
+#define RECORD_EMPTY 0
+#define RECORD_VALID 1
+
+
+struct TemplateSnapshot::Header
+{
+	char magic[8];
+	quint32 version;
+	quint32 capacity;			// number of records
+	quint32 recordSize;
+	quint32 reserved;
+	quint64 generation;			// incremented with every change
+};
+
+struct TemplateSnapshot::Record
+{
+	quint32 state;				// RECORD_EMPTY, RECORD_VALID (written last)
+	quint16 length;				// template size in bytes
+	quint16 checksum;			// CRC-16 of md5 and data (contiguous)
+	char md5[16];				// MD5 hash of the template
+	char data[TEMPLATE_SIZE];
+};
+
+
+TemplateSnapshot::TemplateSnapshot() : file(SNAPSHOT_FILE)
+{
+	map = nullptr;
+	size = 0;
+	inMemory = false;
+}
+
+
+TemplateSnapshot::~TemplateSnapshot()
+{
+	if(inMemory)
+	{
+		delete[] map;
+	}
+	else if(map)
+	{
+		file.unmap(map);
+	}
+}
+
+
+/*
+ * map the snapshot file, a file with a different layout or capacity is cleared
+ * if the file cannot be used, the snapshot is kept in memory (templates are read from it in any case)
+ * return value: false if the snapshot is not persistent
+ */
+bool TemplateSnapshot::open(int capacity)
+{
+	qint64 fileSize = qint64(sizeof(Header)) + qint64(capacity) * qint64(sizeof(Record));
+	bool valid = false;
+	
+	if(!file.open(QIODevice::ReadWrite))
+	{
+		qWarning() << "snapshot: could not open" << file.fileName() << ":" << file.errorString();
+	}
+	else
+	{
+		valid = (file.size() == fileSize);
+		if(!valid && (!file.resize(0) || !file.resize(fileSize)))
+		{
+			qWarning() << "snapshot: could not resize" << file.fileName() << ":" << file.errorString();
+		}
+		else
+		{
+			map = file.map(0, fileSize);
+			if(!map)
+			{
+				qWarning() << "snapshot: could not map" << file.fileName() << ":" << file.errorString();
+			}
+		}
+	}
+	
+	if(!map)
+	{
+		file.close();
+		qWarning() << "snapshot: kept in memory";
+		map = new uchar[fileSize];
+		inMemory = true;
+		valid = false;
+	}
+	size = capacity;
+	
+	Header* h = header();
+	if(!valid || std::strncmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0 || h->version != SNAPSHOT_VERSION
+	   || h->capacity != quint32(capacity) || h->recordSize != sizeof(Record))
+	{
+		// new or incompatible file, all records empty
+		std::memset(map, 0, size_t(fileSize));
+		std::strncpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+		h->version = SNAPSHOT_VERSION;
+		h->capacity = quint32(capacity);
+		h->recordSize = sizeof(Record);
+		qDebug() << "snapshot: created for" << capacity << "templates";
+		return !inMemory;
+	}
+	
+	qDebug() << "snapshot: generation" << h->generation << "," << ids().count() << "templates";
+	return true;
+}
+
+
+quint64 TemplateSnapshot::generation() const
+{
+	return map ? header()->generation : 0;
+}
+
+
+/*
+ * a valid template of <id> is in the snapshot
+ */
+bool TemplateSnapshot::contains(int id) const
+{
+	Record* r = record(id);
+	return r && isValid(r);
+}
+
+
+/*
+ * MD5 hash of the template of <id> (hex), empty if not contained
+ */
+QByteArray TemplateSnapshot::md5(int id) const
+{
+	Record* r = record(id);
+	if(!r || !isValid(r))
+	{
+		return QByteArray();
+	}
+	return QByteArray(r->md5, sizeof(r->md5)).toHex();
+}
+
+
+/*
+ * template of <id>, refers to the mapped file (valid until the record is changed)
+ */
+QByteArray TemplateSnapshot::fpTemplate(int id) const
+{
+	Record* r = record(id);
+	if(!r || !isValid(r))
+	{
+		return QByteArray();
+	}
+	return QByteArray::fromRawData(r->data, r->length);
+}
+
+
+/*
+ * template hashes of all contained IDs
+ */
+QHash<int, QByteArray> TemplateSnapshot::hashes() const
+{
+	QHash<int, QByteArray> result;
+	for(int id = 0; id < size; id++)
+	{
+		Record* r = record(id);
+		if(isValid(r))
+		{
+			result.insert(id, QByteArray(r->md5, sizeof(r->md5)).toHex());
+		}
+	}
+	return result;
+}
+
+
+SlotBitmap TemplateSnapshot::ids() const
+{
+	SlotBitmap result(size);
+	for(int id = 0; id < size; id++)
+	{
+		if(contains(id))
+		{
+			result.insert(id);
+		}
+	}
+	return result;
+}
+
+
+/*
+ * write the template of <id>, the record is invalid while it is written
+ */
+void TemplateSnapshot::store(int id, const QByteArray& fpTemplate)
+{
+	Record* r = record(id);
+	if(!r || fpTemplate.size() > TEMPLATE_SIZE)
+	{
+		return;
+	}
+	
+	QByteArray hash = QCryptographicHash::hash(fpTemplate, QCryptographicHash::Md5);
+	if(isValid(r) && r->length == fpTemplate.size() && std::memcmp(r->md5, hash.constData(), sizeof(r->md5)) == 0)
+	{
+		// unchanged
+		return;
+	}
+	
+	r->state = RECORD_EMPTY;
+	r->length = quint16(fpTemplate.size());
+	std::memcpy(r->md5, hash.constData(), sizeof(r->md5));
+	std::memcpy(r->data, fpTemplate.constData(), size_t(fpTemplate.size()));
+	r->checksum = qChecksum(r->md5, uint(sizeof(r->md5) + r->length));
+	r->state = RECORD_VALID;
+	
+	changed();
+}
+
+
+void TemplateSnapshot::remove(int id)
+{
+	Record* r = record(id);
+	if(!r || r->state == RECORD_EMPTY)
+	{
+		return;
+	}
+	
+	r->state = RECORD_EMPTY;
+	changed();
+}
+
+
+/*
+ * remove the templates that are not in the database or differ from it
+ */
+void TemplateSnapshot::retain(const QHash<int, QByteArray>& dbHashes)
+{
+	for(int id = 0; id < size; id++)
+	{
+		Record* r = record(id);
+		if(r->state != RECORD_EMPTY && (!isValid(r) || md5(id) != dbHashes.value(id)))
+		{
+			remove(id);
+		}
+	}
+}
+
+
+TemplateSnapshot::Header* TemplateSnapshot::header() const
+{
+	return reinterpret_cast<Header*>(map);
+}
+
+
+TemplateSnapshot::Record* TemplateSnapshot::record(int id) const
+{
+	if(!map || id < 0 || id >= size)
+	{
+		return nullptr;
+	}
+	return reinterpret_cast<Record*>(map + sizeof(Header)) + id;
+}
+
+
+/*
+ * record is complete and its checksum is correct
+ */
+bool TemplateSnapshot::isValid(const Record* r) const
+{
+	return r->state == RECORD_VALID && r->length <= TEMPLATE_SIZE
+		   && r->checksum == qChecksum(r->md5, uint(sizeof(r->md5) + r->length));
+}
+
+
+void TemplateSnapshot::changed()
+{
+	header()->generation++;
+}
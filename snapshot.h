@@ -0,0 +1,54 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <QFile>
+#include <QHash>
+#include <QByteArray>
+
+#include "slotbitmap.h"
+
+/*
+ * local copy of the templates in the database, memory mapped from SNAPSHOT_FILE
+ * 
+ * The file has a header and one fixed-size record per database ID (template, MD5 hash, checksum).
+ * Templates are read from the mapping without copying. The snapshot is a source of templates if
+ * the database is not available, otherwise only templates that changed are read from the database.
+ * Every change increments the generation number in the header.
+ */
+class TemplateSnapshot
+{
+public:
+	TemplateSnapshot();
+	~TemplateSnapshot();
+	
+	bool open(int capacity);
+	bool isOpen() const { return map != nullptr; }
+	int capacity() const { return size; }
+	quint64 generation() const;
+	
+	bool contains(int id) const;
+	QByteArray md5(int id) const;
+	QByteArray fpTemplate(int id) const;
+	QHash<int, QByteArray> hashes() const;
+	SlotBitmap ids() const;
+	
+	void store(int id, const QByteArray& fpTemplate);
+	void remove(int id);
+	void retain(const QHash<int, QByteArray>& dbHashes);
+	
+private:
+	struct Header;
+	struct Record;
+	
+	Header* header() const;
+	Record* record(int id) const;
+	bool isValid(const Record* r) const;
+	void changed();
+	
+	QFile file;
+	uchar* map;
+	int size;		// number of records
+	bool inMemory;	// the file could not be used, <map> is allocated
+};
+
+#endif // SNAPSHOT_H
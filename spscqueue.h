@@ -0,0 +1,62 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QAtomicInteger>
+
+/*
+ * bounded lock-free queue for one producer thread and one consumer thread
+ * 
+ * The items are copied into a fixed ring buffer of N entries (N must be a power of 2), push() and
+ * pop() do not allocate. The producer only writes tail, the consumer only writes head.
+ */
+template <typename T, int N>
+class SpscQueue
+{
+	static_assert(N > 0 && (N & (N-1)) == 0, "SpscQueue: capacity must be a power of 2");
+	
+public:
+	SpscQueue() : head(0), tail(0) {}
+	
+	/*
+	 * producer: append <item>
+	 * return value: false if the queue is full
+	 */
+	bool push(const T& item)
+	{
+		quint32 t = tail.load();
+		if(t - head.loadAcquire() >= quint32(N))
+		{
+			return false;
+		}
+		
+		buffer[t & (N-1)] = item;
+		tail.storeRelease(t + 1);
+		return true;
+	}
+	
+	/*
+	 * consumer: take the oldest item
+	 * return value: false if the queue is empty
+	 */
+	bool pop(T& item)
+	{
+		quint32 h = head.load();
+		if(h == tail.loadAcquire())
+		{
+			return false;
+		}
+		
+		item = buffer[h & (N-1)];
+		head.storeRelease(h + 1);
+		return true;
+	}
+	
+	bool isEmpty() const { return head.loadAcquire() == tail.loadAcquire(); }
+	
+private:
+	T buffer[N];
+	alignas(64) QAtomicInteger<quint32> head;		// next item to pop, written by the consumer
+	alignas(64) QAtomicInteger<quint32> tail;		// next free entry, written by the producer
+};
+
+#endif // SPSCQUEUE_H
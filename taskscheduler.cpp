@@ -0,0 +1,144 @@
+#include "taskscheduler.h"
+
+#include <QDebug>
+
+#include <limits.h>
+
+
+#define RETRY_DELAY 100		// (milliseconds) retry of a triggered task that could not run
+
+
+TaskScheduler::TaskScheduler()
+{
+	clock.start();
+}
+
+
+/*
+ * add a task that runs every <period> milliseconds, the first run is in the next slice
+ */
+int TaskScheduler::add(const QString& name, int period, Run run)
+{
+	tasks.append({name, period, run, 0, 0, false});
+	return tasks.size() - 1;
+}
+
+
+void TaskScheduler::setPeriod(int task, int period)
+{
+	Task& t = tasks[task];
+	t.due += period - t.period;
+	t.period = period;
+}
+
+
+void TaskScheduler::trigger(int task)
+{
+	tasks[task].triggered = true;
+}
+
+
+/*
+ * time until the next task with a period is due, the thread can sleep until then
+ */
+int TaskScheduler::idleTime() const
+{
+	qint64 now = clock.elapsed();
+	qint64 next = -1;
+	
+	for(const Task& t : tasks)
+	{
+		if(t.triggered)
+		{
+			return 0;
+		}
+		if(t.period > 0 && (next < 0 || t.due < next))
+		{
+			next = t.due;
+		}
+	}
+	
+	if(next < 0)
+	{
+		return INT_MAX;
+	}
+	return int(qMax(next - now, qint64(0)));
+}
+
+
+/*
+ * run due tasks until <budget> milliseconds are used up
+ * return value: number of tasks that were run
+ */
+int TaskScheduler::runSlice(int budget)
+{
+	QElapsedTimer slice;
+	slice.start();
+
+	QVector<bool> tried(tasks.size(), false);
+	int count = 0;
+
+	while(true)
+	{
+		qint64 now = clock.elapsed();
+		int remaining = budget - int(slice.elapsed());
+
+		// earliest deadline first, triggered tasks before all others
+		int next = -1;
+		for(int i = 0; i < tasks.size(); i++)
+		{
+			const Task& t = tasks[i];
+			if(tried[i] || !(t.triggered || now >= t.due))
+			{
+				continue;
+			}
+			if(count > 0 && t.cost > remaining)
+			{
+				continue;
+			}
+
+			qint64 deadline = t.triggered ? 0 : t.due;
+			if(next < 0 || deadline < (tasks[next].triggered ? 0 : tasks[next].due))
+			{
+				next = i;
+			}
+		}
+		if(next < 0)
+		{
+			break;
+		}
+		tried[next] = true;
+
+		Task& t = tasks[next];
+		QElapsedTimer timer;
+		timer.start();
+		bool ran = t.run();
+		int duration = int(timer.elapsed());
+
+		if(!ran)
+		{
+			// not due again immediately, idleTime() would be 0 until the task can run
+			t.due = clock.elapsed() + (t.triggered ? qMin(t.period, RETRY_DELAY) : t.period);
+			t.triggered = false;
+			continue;
+		}
+		count++;
+
+		// the estimate follows longer runs immediately and shorter ones slowly
+		t.cost = duration > t.cost ? duration : (3*t.cost + duration) / 4;
+		t.triggered = false;
+		t.due = clock.elapsed() + t.period;
+
+		if(duration > budget)
+		{
+			qWarning() << "background task" << t.name << "took" << duration << "ms, budget" << budget << "ms";
+		}
+
+		if(slice.elapsed() >= budget)
+		{
+			break;
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,53 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+/*
+ * cooperative scheduler for the background work of the sensor thread
+ *
+ * The background tasks run between two finger scans, one slice at a time. A slice runs the due tasks,
+ * earliest deadline first, until its time budget is used up. A task is only started if its recent run
+ * time fits into the rest of the budget (the first task of a slice always runs, so no task starves).
+ * Tasks do one step per run, the finger scan runs again after each slice. Tasks with period 0 run in
+ * every slice, they are not considered by idleTime().
+ */
+
+#include <QString>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include <functional>
+
+
+class TaskScheduler
+{
+public:
+
+	// return value: false if the task could not run, it is retried after its period (triggered: after RETRY_DELAY)
+	typedef std::function<bool()> Run;
+
+	TaskScheduler();
+
+	int add(const QString& name, int period, Run run);		// period in milliseconds, return value: task handle
+	void setPeriod(int task, int period);
+	void trigger(int task);				// run <task> in the next slice
+
+	int runSlice(int budget);			// budget in milliseconds, return value: number of tasks run
+	int idleTime() const;				// (milliseconds) time until the next task is due
+
+private:
+
+	struct Task
+	{
+		QString name;
+		int period;			// (milliseconds)
+		Run run;
+		qint64 due;			// (milliseconds) time of the next run
+		int cost;			// (milliseconds) estimated run time
+		bool triggered;		// run in the next slice
+	};
+
+	QVector<Task> tasks;
+	QElapsedTimer clock;
+};
+
+#endif // TASKSCHEDULER_H
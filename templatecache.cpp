@@ -0,0 +1,180 @@
+#include "templatecache.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <algorithm>
+
+
+#define REPORT_INTERVAL 100		// identifications between statistic reports
+
+
+TemplateCache::TemplateCache(Fingerprint* fp, SensorLibrary* library, const TemplateSnapshot* snapshot)
+{
+	this->fp = fp;
+	this->library = library;
+	this->snapshot = snapshot;
+	
+	useCounter = 0;
+	lookups = 0;
+	hits = 0;
+	pageHits = 0;
+	evictions = 0;
+	missTime = 0;
+}
+
+
+/*
+ * template <id> was found by the search of the sensor library
+ */
+void TemplateCache::hit(int id)
+{
+	lastUsed.insert(id, ++useCounter);
+	lookups++;
+	hits++;
+	
+	if(lookups % REPORT_INTERVAL == 0)
+	{
+		report();
+	}
+}
+
+
+/*
+ * match the feature file in SLOT_1 against the <candidates> that are not in the sensor library,
+ * at most <limit> templates (0: all) within <timeLimit> milliseconds (0: no limit)
+ * candidates that are not yet copied to the snapshot are skipped
+ * additional return parameters:
+ *	* ID, score and template of the match, the template is left in SLOT_2
+ * return value: OK if a template matched, NOTFOUND if none matched, otherwise the error of the sensor
+ */
+Fingerprint::Status TemplateCache::page(const SlotBitmap& candidates, int limit, int timeLimit, int& id, uint16_t& score, QByteArray& fpTemplate)
+{
+	QElapsedTimer timer;
+	timer.start();
+	lookups++;
+	
+	// most recently used first
+	QList<int> ids = order(candidates);
+	
+	bool found = false;
+	Fingerprint::Status result = Fingerprint::NOTFOUND;
+	int tested = 0;
+	
+	for(int candidate : ids)
+	{
+		if(limit > 0 && tested >= limit)
+		{
+			break;
+		}
+		if(timeLimit > 0 && timer.elapsed() >= timeLimit)
+		{
+			qDebug() << "cache: time limit of" << timeLimit << "ms reached";
+			break;
+		}
+		if(!snapshot->contains(candidate))
+		{
+			continue;
+		}
+		
+		id = candidate;
+		fpTemplate = snapshot->fpTemplate(candidate);
+		tested++;
+		
+		Fingerprint::Status status = fp->downChar(Fingerprint::SLOT_2, fpTemplate);
+		if(status != Fingerprint::OK)
+		{
+			fp->printError(status);
+			result = status;
+			break;
+		}
+		
+		status = fp->match(score);
+		if(status == Fingerprint::OK)
+		{
+			found = true;
+			break;
+		}
+		if(status != Fingerprint::NOMATCH)
+		{
+			fp->printError(status);
+			result = status;
+			break;
+		}
+	}
+	
+	qint64 elapsed = timer.elapsed();
+	missTime += elapsed;
+	
+	if(found)
+	{
+		pageHits++;
+		lastUsed.insert(id, ++useCounter);
+		qDebug() << "cache miss, id" << id << "found after" << tested << "of" << ids.size() << "templates in" << elapsed << "ms";
+		result = Fingerprint::OK;
+	}
+	else
+	{
+		qDebug() << "cache miss, no match in" << tested << "templates," << elapsed << "ms";
+	}
+	report();
+	
+	return result;
+}
+
+
+/*
+ * free slot for a new template, the least recently used template is evicted if the library is full
+ * the evicted slot is released in the library, the caller overwrites it
+ * return value: slot, -1 if the library has no capacity
+ */
+int TemplateCache::allocate()
+{
+	int slot = library->occupancy().findFirstFree();
+	if(slot >= 0)
+	{
+		return slot;
+	}
+	
+	int victim = -1;
+	quint64 oldest = 0;
+	for(int s : library->occupancy().toList())
+	{
+		quint64 used = lastUsed.value(library->idAt(s), 0);
+		if(victim < 0 || used < oldest)
+		{
+			victim = s;
+			oldest = used;
+		}
+	}
+	
+	if(victim >= 0)
+	{
+		qDebug() << "cache: evict id" << library->idAt(victim) << "from slot" << victim;
+		library->release(victim);
+		evictions++;
+	}
+	return victim;
+}
+
+
+void TemplateCache::report() const
+{
+	int misses = lookups - hits;
+	qDebug() << "cache:" << library->count() << "resident," << lookups << "lookups, hit rate"
+			 << (lookups > 0 ? hits * 100 / lookups : 0) << "%," << pageHits << "paged in,"
+			 << "miss latency" << (misses > 0 ? missTime / misses : 0) << "ms," << evictions << "evictions";
+}
+
+
+/*
+ * candidates sorted by last use, most recent first
+ */
+QList<int> TemplateCache::order(const SlotBitmap& candidates) const
+{
+	QList<int> ids = candidates.toList();
+	std::stable_sort(ids.begin(), ids.end(), [this](int a, int b)
+	{
+		return lastUsed.value(a, 0) > lastUsed.value(b, 0);
+	});
+	return ids;
+}
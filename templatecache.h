@@ -0,0 +1,49 @@
+#ifndef TEMPLATECACHE_H
+#define TEMPLATECACHE_H
+
+#include <QHash>
+
+#include "fingerprint.h"
+#include "sensorlibrary.h"
+#include "slotbitmap.h"
+#include "snapshot.h"
+
+/*
+ * sensor library as a cache of the templates in the database
+ * 
+ * The sensor searches the cached (resident) templates only. If the search fails, the feature file
+ * in SLOT_1 is matched 1:1 against the templates that are not resident, they are taken from the snapshot
+ * and paged into SLOT_2 one after the other, most recently used first, until the page or time limit is reached. A template that matches is stored in the library,
+ * if the library is full the least recently used template is evicted.
+ */
+class TemplateCache
+{
+public:
+	TemplateCache(Fingerprint* fp, SensorLibrary* library, const TemplateSnapshot* snapshot);
+	
+	void hit(int id);
+	Fingerprint::Status page(const SlotBitmap& candidates, int limit, int timeLimit, int& id, uint16_t& score, QByteArray& fpTemplate);
+	int allocate();
+	void forget(int id) { lastUsed.remove(id); }
+	
+	void report() const;
+	
+private:
+	QList<int> order(const SlotBitmap& candidates) const;
+	
+	Fingerprint* fp;
+	SensorLibrary* library;
+	const TemplateSnapshot* snapshot;
+	
+	QHash<int, quint64> lastUsed;	// ID -> time of last match (use counter)
+	quint64 useCounter;
+	
+	// statistics
+	int lookups;			// identifications
+	int hits;				// found by search of the sensor library
+	int pageHits;			// found by paging
+	int evictions;
+	qint64 missTime;		// (milliseconds) total time of paging
+};
+
+#endif // TEMPLATECACHE_H
@@ -0,0 +1,110 @@
+#include "templateloader.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+
+#define PROGRESS_INTERVAL 2000		// (milliseconds) interval of progress reports
+
+
+TemplateLoader::TemplateLoader(Fingerprint* fp)
+{
+	this->fp = fp;
+	
+	busy[0] = false;
+	busy[1] = false;
+	done = 0;
+	failed = 0;
+}
+
+
+/*
+ * download all templates returned by <next> and store them in the sensor library
+ * return value: number of stored templates
+ */
+int TemplateLoader::load(Source next, const QHash<int, int>& targets, Stored stored)
+{
+	int total = targets.size();
+	this->stored = stored;
+	done = 0;
+	failed = 0;
+	
+	QElapsedTimer timer;
+	timer.start();
+	qint64 lastReport = 0;
+	
+	int id;
+	QByteArray fpTemplate;
+	while(next(id, fpTemplate))
+	{
+		int slot = targets.value(id, -1);
+		if(slot < 0)
+		{
+			continue;
+		}
+		
+		// wait for a free character buffer, the next template is already read meanwhile
+		while(busy[0] && busy[1])
+		{
+			fp->processEvents();
+		}
+		
+		transfer(busy[0] ? Fingerprint::SLOT_2 : Fingerprint::SLOT_1, id, slot, fpTemplate);
+		
+		if(timer.elapsed() - lastReport >= PROGRESS_INTERVAL)
+		{
+			lastReport = timer.elapsed();
+			qDebug() << "\tloaded" << done << "of" << total << "templates";
+		}
+	}
+	
+	// wait until the pipeline is empty
+	while(busy[0] || busy[1])
+	{
+		fp->processEvents();
+	}
+	
+	qint64 elapsed = timer.elapsed();
+	qDebug() << "\tloaded" << done << "of" << total << "templates in" << elapsed << "ms,"
+			 << failed << "failed," << (elapsed > 0 ? done * 1000 / elapsed : done) << "templates/s";
+	
+	return done;
+}
+
+
+/*
+ * download template into character <buffer> and store it in the library at <slot>
+ */
+void TemplateLoader::transfer(Fingerprint::Slot buffer, int id, int slot, const QByteArray& fpTemplate)
+{
+	busy[buffer-1] = true;
+	
+	fp->downCharAsync(buffer, fpTemplate, [this, buffer, id, slot, fpTemplate](Fingerprint::Status status, const QByteArray&)
+	{
+		if(status != Fingerprint::OK)
+		{
+			fp->printError(status);
+			failed++;
+			busy[buffer-1] = false;
+			return;
+		}
+		
+		fp->storeModelAsync(buffer, uint16_t(slot), [this, buffer, id, slot, fpTemplate](Fingerprint::Status status, const QByteArray&)
+		{
+			busy[buffer-1] = false;
+			
+			if(status != Fingerprint::OK)
+			{
+				fp->printError(status);
+				failed++;
+				return;
+			}
+			
+			done++;
+			if(this->stored)
+			{
+				this->stored(id, slot, fpTemplate);
+			}
+		});
+	});
+}
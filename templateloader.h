@@ -0,0 +1,39 @@
+#ifndef TEMPLATELOADER_H
+#define TEMPLATELOADER_H
+
+#include <QHash>
+#include <QByteArray>
+#include <functional>
+
+#include "fingerprint.h"
+
+/*
+ * bulk download of fingerprint templates to the sensor library
+ * 
+ * Every template is stored in the slot given for its database ID.
+ * Templates are read from a source (e.g. the snapshot). Both character buffers of the sensor are used
+ * alternately, so the next template is read while the previous one is transferred and stored on the sensor.
+ */
+class TemplateLoader
+{
+public:
+	explicit TemplateLoader(Fingerprint* fp);
+	
+	typedef std::function<void(int id, int slot, const QByteArray& fpTemplate)> Stored;
+	typedef std::function<bool(int& id, QByteArray& fpTemplate)> Source;		// next template, false at the end
+	
+	// targets maps IDs to library slots, stored is called for every template stored on the sensor
+	int load(Source next, const QHash<int, int>& targets, Stored stored);
+	
+private:
+	void transfer(Fingerprint::Slot buffer, int id, int slot, const QByteArray& fpTemplate);
+	
+	Fingerprint* fp;
+	
+	bool busy[2];			// character buffer in use
+	int done;				// number of templates stored
+	int failed;				// number of failed transfers
+	Stored stored;
+};
+
+#endif // TEMPLATELOADER_H